@@ -0,0 +1,705 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <invader/command_line_option.hpp>
+#include <invader/version.hpp>
+#include <invader/printf.hpp>
+#include <invader/tag/parser/parser.hpp>
+#include <invader/sound/sound_encoder.hpp>
+#include <invader/bitmap/pixel.hpp>
+#include <invader/bitmap/bitmap_encode.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "synthetic_tags.hpp"
+#include "../src/actions.hpp"
+#include "../src/dxt_swizzle.hpp"
+#include "../src/mipmap.hpp"
+#include "../src/parallel.hpp"
+#include "../src/scan.hpp"
+#include "../src/sound_stream.hpp"
+#include "../src/swizzle.hpp"
+#include "../src/tiled_encode.hpp"
+#include "../src/xbox_adpcm.hpp"
+
+struct BenchOptions {
+    std::size_t iterations = 3;
+    std::size_t threads = 0;
+    double scale = 1.0;
+    const char *filter = nullptr;
+    const char *output = nullptr;
+};
+
+enum BenchUnit {
+    BENCH_UNIT_PIXELS,
+    BENCH_UNIT_SAMPLES
+};
+
+// Every run of one action or stage on one tag
+struct BenchResult {
+    BenchUnit unit;
+    std::size_t count;
+    std::vector<double> seconds;
+};
+
+using BenchResultKey = std::tuple<std::string, std::string, std::string>; // kind, name, tag
+
+class BenchReport {
+public:
+    void add(const char *kind, const std::string &name, const std::string &tag, BenchUnit unit, std::size_t count, double seconds) {
+        auto &result = this->results[BenchResultKey(kind, name, tag)];
+        result.unit = unit;
+        result.count = count;
+        result.seconds.emplace_back(seconds);
+    }
+
+    // Record whether a faster path gave the same output as the one it replaces
+    void check(const std::string &name, const std::string &tag, bool passed) {
+        this->checks[std::make_pair(name, tag)] = passed;
+        if(!passed) {
+            eprintf_error("Check %s failed for %s", name.c_str(), tag.c_str());
+        }
+    }
+
+    bool all_checks_passed() const noexcept {
+        return std::all_of(this->checks.begin(), this->checks.end(), [](auto &check) { return check.second; });
+    }
+
+    void write_json(std::FILE *file, const BenchOptions &options) const {
+        std::fprintf(file, "{\n");
+        std::fprintf(file, "  \"last_resort\": \"%s\",\n", LAST_RESORT_VERSION);
+        std::fprintf(file, "  \"invader\": \"%s\",\n", Invader::full_version());
+        std::fprintf(file, "  \"threads\": %zu,\n", LastResort::get_thread_count());
+        std::fprintf(file, "  \"iterations\": %zu,\n", options.iterations);
+        std::fprintf(file, "  \"scale\": %g,\n", options.scale);
+
+        // Each tag on its own
+        std::fprintf(file, "  \"results\": [");
+        const char *separator = "\n";
+        for(auto &[key, result] : this->results) {
+            auto &[kind, name, tag] = key;
+            double min_seconds = std::numeric_limits<double>::max(), total_seconds = 0.0;
+            for(auto s : result.seconds) {
+                min_seconds = std::min(min_seconds, s);
+                total_seconds += s;
+            }
+            std::fprintf(file, "%s    { \"kind\": \"%s\", \"name\": \"%s\", \"tag\": \"%s\", ", separator, kind.c_str(), name.c_str(), tag.c_str());
+            write_throughput(file, result.unit, result.count, min_seconds, total_seconds / result.seconds.size());
+            std::fprintf(file, " }");
+            separator = ",\n";
+        }
+        std::fprintf(file, "\n  ],\n");
+
+        // Then every tag together, using the best time for each so the totals are as stable as the individual results
+        std::map<std::pair<std::string, std::string>, std::tuple<BenchUnit, std::size_t, double, double>> totals;
+        for(auto &[key, result] : this->results) {
+            auto &[kind, name, tag] = key;
+            auto &[unit, count, min_seconds, mean_seconds] = totals[std::make_pair(kind, name)];
+            double best = std::numeric_limits<double>::max(), total_seconds = 0.0;
+            for(auto s : result.seconds) {
+                best = std::min(best, s);
+                total_seconds += s;
+            }
+            unit = result.unit;
+            count += result.count;
+            min_seconds += best;
+            mean_seconds += total_seconds / result.seconds.size();
+        }
+
+        std::fprintf(file, "  \"totals\": [");
+        separator = "\n";
+        for(auto &[key, total] : totals) {
+            auto &[unit, count, min_seconds, mean_seconds] = total;
+            std::fprintf(file, "%s    { \"kind\": \"%s\", \"name\": \"%s\", ", separator, key.first.c_str(), key.second.c_str());
+            write_throughput(file, unit, count, min_seconds, mean_seconds);
+            std::fprintf(file, " }");
+            separator = ",\n";
+        }
+        std::fprintf(file, "\n  ],\n");
+
+        std::fprintf(file, "  \"checks\": [");
+        separator = "\n";
+        for(auto &[key, passed] : this->checks) {
+            std::fprintf(file, "%s    { \"name\": \"%s\", \"tag\": \"%s\", \"passed\": %s }", separator, key.first.c_str(), key.second.c_str(), passed ? "true" : "false");
+            separator = ",\n";
+        }
+        std::fprintf(file, "\n  ],\n");
+
+        struct rusage usage = {};
+        getrusage(RUSAGE_SELF, &usage);
+        std::fprintf(file, "  \"peak_rss_kib\": %ld\n", static_cast<long>(usage.ru_maxrss));
+        std::fprintf(file, "}\n");
+    }
+
+private:
+    std::map<BenchResultKey, BenchResult> results;
+    std::map<std::pair<std::string, std::string>, bool> checks;
+
+    static void write_throughput(std::FILE *file, BenchUnit unit, std::size_t count, double min_seconds, double mean_seconds) {
+        if(unit == BenchUnit::BENCH_UNIT_PIXELS) {
+            std::fprintf(file, "\"pixels\": %zu, \"min_seconds\": %.6f, \"mean_seconds\": %.6f, \"mpixels_per_second\": %.3f", count, min_seconds, mean_seconds, count / min_seconds / 1000000.0);
+        }
+        else {
+            std::fprintf(file, "\"samples\": %zu, \"min_seconds\": %.6f, \"mean_seconds\": %.6f, \"samples_per_second\": %.0f", count, min_seconds, mean_seconds, count / min_seconds);
+        }
+    }
+};
+
+template <typename F> static double time_seconds(const F &function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool matches_filter(const BenchOptions &options, const std::string &name, const std::string &tag) {
+    return options.filter == nullptr || name.find(options.filter) != std::string::npos || tag.find(options.filter) != std::string::npos;
+}
+
+static std::unique_ptr<Invader::Parser::ParserStruct> parse_tag(BenchReport &report, const std::string &tag, BenchUnit unit, std::size_t count, const std::vector<std::byte> &tag_data) {
+    std::unique_ptr<Invader::Parser::ParserStruct> parsed;
+    report.add("stage", "parse", tag, unit, count, time_seconds([&parsed, &tag_data]() {
+        parsed = Invader::Parser::ParserStruct::parse_hek_tag_file(tag_data.data(), tag_data.size());
+    }));
+    return parsed;
+}
+
+static std::vector<std::byte> generate_tag(BenchReport &report, const std::string &tag, BenchUnit unit, std::size_t count, Invader::Parser::ParserStruct &parsed, Invader::HEK::TagFourCC fourcc) {
+    std::vector<std::byte> tag_data;
+    report.add("stage", "generate", tag, unit, count, time_seconds([&parsed, &fourcc, &tag_data]() {
+        tag_data = parsed.generate_hek_tag_data(fourcc);
+    }));
+    return tag_data;
+}
+
+static void bench_bitmap_actions(BenchReport &report, const BenchOptions &options, const LastResort::Bench::SyntheticBitmap &bitmap) {
+    using namespace LastResort;
+
+    struct BitmapAction {
+        const char *name;
+        void (*function)(Invader::Parser::Bitmap *, const BitmapOptions &);
+        BitmapOptions options;
+    };
+
+    BitmapOptions dither;
+    dither.dither = true;
+    BitmapOptions mipmaps;
+    mipmaps.generate_mipmaps = true;
+    mipmaps.gamma_correct_mipmaps = true;
+
+    const BitmapAction actions[] = {
+        { "hud-meter-swap", hud_meter_swap, {} },
+        { "multi-gbx-to-xbox", multi_gbx_to_xbox, {} },
+        { "multi-xbox-to-gbx", multi_xbox_to_gbx, {} },
+        { "bitmap-passthrough", bitmap_passthrough, {} },
+        { "bitmap-passthrough-dither", bitmap_passthrough, dither },
+        { "bitmap-passthrough-mipmaps", bitmap_passthrough, mipmaps }
+    };
+
+    for(auto &action : actions) {
+        if(!matches_filter(options, action.name, bitmap.name)) {
+            continue;
+        }
+        for(std::size_t i = 0; i < options.iterations; i++) {
+            auto parsed = parse_tag(report, bitmap.name, BenchUnit::BENCH_UNIT_PIXELS, bitmap.pixel_count, bitmap.tag_data);
+            auto *bitmap_tag = dynamic_cast<Invader::Parser::Bitmap *>(parsed.get());
+            report.add("action", action.name, bitmap.name, BenchUnit::BENCH_UNIT_PIXELS, bitmap.pixel_count, time_seconds([&bitmap_tag, &action]() {
+                action.function(bitmap_tag, action.options);
+            }));
+            auto converted = generate_tag(report, bitmap.name, BenchUnit::BENCH_UNIT_PIXELS, bitmap.pixel_count, *parsed, Invader::HEK::TagFourCC::TAG_FOURCC_BITMAP);
+
+            // Convert it again remembering the result, then once more reusing it; both must give the same tag
+            auto reuse_options = action.options;
+            reuse_options.reuse_results = true;
+            clear_conversion_memo();
+            for(const char *suffix : { "-store", "-reuse" }) {
+                auto reuse_name = std::string(action.name) + suffix;
+                auto reparsed = Invader::Parser::ParserStruct::parse_hek_tag_file(bitmap.tag_data.data(), bitmap.tag_data.size());
+                auto *reparsed_tag = dynamic_cast<Invader::Parser::Bitmap *>(reparsed.get());
+                report.add("action", reuse_name, bitmap.name, BenchUnit::BENCH_UNIT_PIXELS, bitmap.pixel_count, time_seconds([&reparsed_tag, &action, &reuse_options]() {
+                    action.function(reparsed_tag, reuse_options);
+                }));
+                if(i == 0) {
+                    report.check(reuse_name, bitmap.name, reparsed->generate_hek_tag_data(Invader::HEK::TagFourCC::TAG_FOURCC_BITMAP) == converted);
+                }
+            }
+        }
+    }
+}
+
+static void bench_bitmap_stages(BenchReport &report, const BenchOptions &options, const LastResort::Bench::SyntheticBitmap &bitmap) {
+    using namespace Invader;
+    using namespace LastResort;
+
+    auto parsed = Parser::ParserStruct::parse_hek_tag_file(bitmap.tag_data.data(), bitmap.tag_data.size());
+    auto *bitmap_tag = dynamic_cast<Parser::Bitmap *>(parsed.get());
+    auto &data = bitmap_tag->bitmap_data[0];
+    auto *input = bitmap_tag->processed_pixel_data.data() + data.pixel_data_offset;
+    auto input_size = BitmapEncode::bitmap_data_size(data.width, data.height, data.depth, data.mipmap_count, data.format, data.type);
+
+    auto hud_meter_swap_pixel = [](Pixel &pixel) {
+        std::uint8_t mask = pixel.convert_to_y8();
+        std::uint8_t meter = pixel.alpha;
+        pixel.alpha = mask;
+        pixel.red = meter;
+        pixel.green = meter;
+        pixel.blue = meter;
+    };
+    auto multi_gbx_to_xbox_pixel = [](Pixel &pixel) {
+        Pixel new_pixel;
+        new_pixel.green = pixel.green;
+        new_pixel.alpha = 0xFF;
+        new_pixel.red = pixel.blue;
+        new_pixel.blue = pixel.alpha;
+        pixel = new_pixel;
+    };
+    auto multi_xbox_to_gbx_pixel = [](Pixel &pixel) {
+        Pixel new_pixel;
+        new_pixel.green = pixel.green;
+        new_pixel.red = 0x00;
+        new_pixel.blue = pixel.red;
+        new_pixel.alpha = pixel.blue;
+        pixel = new_pixel;
+    };
+
+    for(std::size_t i = 0; i < options.iterations; i++) {
+        std::vector<std::byte> decoded;
+        if(matches_filter(options, "decode", bitmap.name)) {
+            report.add("stage", "decode", bitmap.name, BenchUnit::BENCH_UNIT_PIXELS, bitmap.pixel_count, time_seconds([&]() {
+                decoded = BitmapEncode::encode_bitmap(input, data.format, HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8, data.width, data.height, data.depth, data.type, data.mipmap_count);
+            }));
+        }
+        else {
+            decoded = BitmapEncode::encode_bitmap(input, data.format, HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8, data.width, data.height, data.depth, data.type, data.mipmap_count);
+        }
+        auto *pixels = reinterpret_cast<Pixel *>(decoded.data());
+        auto pixel_count = decoded.size() / sizeof(Pixel);
+
+        // Every kernel has to give exactly what the per-pixel functions do, so check against those before timing anything
+        std::vector<Pixel> reference;
+        auto apply_reference = [&reference, &pixels, &pixel_count](const auto &modify_pixel) {
+            reference.assign(pixels, pixels + pixel_count);
+            for(auto &pixel : reference) {
+                modify_pixel(pixel);
+            }
+        };
+        auto matches_reference = [&reference](const std::vector<Pixel> &output) {
+            return std::memcmp(output.data(), reference.data(), reference.size() * sizeof(Pixel)) == 0;
+        };
+        for(std::size_t k = 0; k < SwizzleKernel::SWIZZLE_KERNEL_COUNT; k++) {
+            auto kernel = static_cast<SwizzleKernel>(k);
+            if(!swizzle_kernel_supported(kernel)) {
+                continue;
+            }
+            auto kernel_name = std::string(swizzle_kernel_name(kernel));
+
+            if(i == 0) {
+                auto check_shuffle = [&](const char *name, const auto &modify_pixel) {
+                    apply_reference(modify_pixel);
+                    std::vector<Pixel> output(pixels, pixels + pixel_count);
+                    auto shuffle = derive_pixel_shuffle(modify_pixel);
+                    if(shuffle.has_value()) {
+                        shuffle_pixels_with_kernel(output.data(), output.size(), *shuffle, kernel);
+                    }
+                    report.check(std::string(name) + "-shuffle-" + kernel_name, bitmap.name, shuffle.has_value() && matches_reference(output));
+                };
+                check_shuffle("multi-gbx-to-xbox", multi_gbx_to_xbox_pixel);
+                check_shuffle("multi-xbox-to-gbx", multi_xbox_to_gbx_pixel);
+            }
+
+            auto &weights = get_luminance_weights();
+            auto stage_name = "hud-meter-swap-" + kernel_name;
+            if(weights.has_value() && matches_filter(options, stage_name.c_str(), bitmap.name)) {
+                std::vector<Pixel> output(pixels, pixels + pixel_count);
+                report.add("stage", stage_name, bitmap.name, BenchUnit::BENCH_UNIT_PIXELS, pixel_count, time_seconds([&]() {
+                    hud_meter_swap_pixels_with_kernel(output.data(), output.size(), *weights, kernel);
+                }));
+                if(i == 0) {
+                    apply_reference(hud_meter_swap_pixel);
+                    report.check(stage_name, bitmap.name, matches_reference(output));
+                }
+            }
+        }
+
+        if(matches_filter(options, "swizzle", bitmap.name)) {
+            report.add("stage", "swizzle", bitmap.name, BenchUnit::BENCH_UNIT_PIXELS, pixel_count, time_seconds([&]() {
+                swizzle_pixels(pixels, pixel_count, hud_meter_swap_pixel);
+            }));
+        }
+
+        if(data.mipmap_count > 0 && can_generate_mipmaps(data.type, data.depth)) {
+            for(bool gamma_correct : { false, true }) {
+                const char *name = gamma_correct ? "mipmaps-gamma" : "mipmaps";
+                if(matches_filter(options, name, bitmap.name)) {
+                    report.add("stage", name, bitmap.name, BenchUnit::BENCH_UNIT_PIXELS, pixel_count, time_seconds([&]() {
+                        generate_mipmap_chain(pixels, data.width, data.height, data.depth, data.type, data.mipmap_count, gamma_correct);
+                    }));
+                }
+            }
+        }
+
+        for(bool dither : { false, true }) {
+            const char *name = dither ? "encode-dither" : "encode";
+            if(matches_filter(options, name, bitmap.name)) {
+                report.add("stage", name, bitmap.name, BenchUnit::BENCH_UNIT_PIXELS, pixel_count, time_seconds([&]() {
+                    BitmapEncode::encode_bitmap(decoded.data(), HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8, data.format, data.width, data.height, data.depth, data.type, data.mipmap_count, dither, dither, dither, dither);
+                }));
+            }
+
+            const char *tiled_name = dither ? "encode-tiled-dither" : "encode-tiled";
+            if(matches_filter(options, tiled_name, bitmap.name)) {
+                std::vector<std::byte> tiled;
+                report.add("stage", tiled_name, bitmap.name, BenchUnit::BENCH_UNIT_PIXELS, pixel_count, time_seconds([&]() {
+                    tiled = encode_bitmap_tiled(pixels, data.format, data.width, data.height, data.depth, data.type, data.mipmap_count, dither);
+                }));
+
+                // Tiles must not depend on the thread count, and without dithering, they must not change anything at all
+                if(i == 0) {
+                    ThreadCountScope one_thread(1);
+                    report.check(std::string(tiled_name) + "-one-thread", bitmap.name, tiled == encode_bitmap_tiled(pixels, data.format, data.width, data.height, data.depth, data.type, data.mipmap_count, dither));
+                    if(!dither) {
+                        report.check(std::string(tiled_name) + "-whole-chain", bitmap.name, tiled == BitmapEncode::encode_bitmap(decoded.data(), HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8, data.format, data.width, data.height, data.depth, data.type, data.mipmap_count));
+                    }
+                }
+            }
+        }
+
+        if(is_dxt_format(data.format) && matches_filter(options, "dxt-shuffle", bitmap.name)) {
+            std::vector<std::byte> blocks(input, input + input_size);
+            auto &shuffle = get_pixel_shuffle(multi_gbx_to_xbox_pixel);
+            report.add("stage", "dxt-shuffle", bitmap.name, BenchUnit::BENCH_UNIT_PIXELS, bitmap.pixel_count, time_seconds([&]() {
+                shuffle_dxt_blocks(blocks.data(), blocks.size(), data.format, *shuffle);
+            }));
+        }
+    }
+}
+
+static void bench_sound_actions(BenchReport &report, const BenchOptions &options, const LastResort::Bench::SyntheticSound &sound) {
+    for(bool fast_adpcm : { false, true }) {
+        const char *action_name = fast_adpcm ? "sound-to-xbox-adpcm-fast" : "sound-to-xbox-adpcm";
+        if(!matches_filter(options, action_name, sound.name)) {
+            continue;
+        }
+        LastResort::SoundOptions sound_options;
+        sound_options.fast_adpcm = fast_adpcm;
+        auto reuse_options = sound_options;
+        reuse_options.reuse_results = true;
+        for(std::size_t i = 0; i < options.iterations; i++) {
+            auto parsed = parse_tag(report, sound.name, BenchUnit::BENCH_UNIT_SAMPLES, sound.sample_count, sound.tag_data);
+            auto *sound_tag = dynamic_cast<Invader::Parser::Sound *>(parsed.get());
+            report.add("action", action_name, sound.name, BenchUnit::BENCH_UNIT_SAMPLES, sound.sample_count, time_seconds([&sound_tag, &sound_options]() {
+                LastResort::sound_to_xbox_adpcm(sound_tag, sound_options);
+            }));
+            auto converted = generate_tag(report, sound.name, BenchUnit::BENCH_UNIT_SAMPLES, sound.sample_count, *parsed, Invader::HEK::TagFourCC::TAG_FOURCC_SOUND);
+
+            LastResort::clear_conversion_memo();
+            for(const char *suffix : { "-store", "-reuse" }) {
+                auto reuse_name = std::string(action_name) + suffix;
+                auto reparsed = Invader::Parser::ParserStruct::parse_hek_tag_file(sound.tag_data.data(), sound.tag_data.size());
+                auto *reparsed_tag = dynamic_cast<Invader::Parser::Sound *>(reparsed.get());
+                report.add("action", reuse_name, sound.name, BenchUnit::BENCH_UNIT_SAMPLES, sound.sample_count, time_seconds([&reparsed_tag, &reuse_options]() {
+                    LastResort::sound_to_xbox_adpcm(reparsed_tag, reuse_options);
+                }));
+                if(i == 0) {
+                    report.check(reuse_name, sound.name, reparsed->generate_hek_tag_data(Invader::HEK::TagFourCC::TAG_FOURCC_SOUND) == converted);
+                }
+            }
+        }
+    }
+}
+
+static void bench_sound_stages(BenchReport &report, const BenchOptions &options, const LastResort::Bench::SyntheticSound &sound) {
+    using namespace Invader;
+
+    auto parsed = Parser::ParserStruct::parse_hek_tag_file(sound.tag_data.data(), sound.tag_data.size());
+    auto *sound_tag = dynamic_cast<Parser::Sound *>(parsed.get());
+    std::size_t channel_count = sound_tag->channel_count == HEK::SoundChannelCount::SOUND_CHANNEL_COUNT_MONO ? 1 : 2;
+
+    // Scanning must find the same permutations to convert as parsing, including when only some of them are Xbox ADPCM
+    if(matches_filter(options, "scan", sound.name)) {
+        auto permutations_to_convert = [](Parser::Sound &tag) {
+            std::size_t count = 0;
+            bool split = tag.flags & HEK::SoundFlagsFlag::SOUND_FLAGS_FLAG_SPLIT_LONG_SOUND_INTO_PERMUTATIONS;
+            for(auto &pitch_range : tag.pitch_ranges) {
+                std::size_t real_permutation_count = split ? std::min<std::size_t>(pitch_range.actual_permutation_count, pitch_range.permutations.size()) : pitch_range.permutations.size();
+                for(std::size_t j = 0; j < real_permutation_count; j++) {
+                    count += pitch_range.permutations[j].format != HEK::SoundFormat::SOUND_FORMAT_XBOX_ADPCM;
+                }
+            }
+            return count;
+        };
+        auto scan = LastResort::scan_tag(sound.tag_data.data(), sound.tag_data.size());
+        report.check("scan-permutations", sound.name, scan.has_value() && scan->sound.has_value() && scan->sound->permutations_to_convert == permutations_to_convert(*sound_tag));
+
+        auto mixed = Parser::ParserStruct::parse_hek_tag_file(sound.tag_data.data(), sound.tag_data.size());
+        auto *mixed_tag = dynamic_cast<Parser::Sound *>(mixed.get());
+        mixed_tag->pitch_ranges[0].permutations[0].format = HEK::SoundFormat::SOUND_FORMAT_XBOX_ADPCM;
+        auto mixed_data = mixed->generate_hek_tag_data(HEK::TagFourCC::TAG_FOURCC_SOUND);
+        auto mixed_scan = LastResort::scan_tag(mixed_data.data(), mixed_data.size());
+        report.check("scan-mixed-permutations", sound.name, mixed_scan.has_value() && mixed_scan->sound.has_value() && mixed_scan->sound->permutations_to_convert == permutations_to_convert(*mixed_tag));
+    }
+
+    for(std::size_t i = 0; i < options.iterations; i++) {
+        // Decode everything up front so the encoder is timed on its own
+        std::vector<std::vector<std::byte>> chunks;
+        double decode_seconds = 0.0;
+        for(auto &permutation : sound_tag->pitch_ranges[0].permutations) {
+            decode_seconds += time_seconds([&]() {
+                LastResort::decode_pcm_chunks(permutation.format, permutation.samples.data(), permutation.samples.size(), channel_count, LastResort::PCM_FRAMES_PER_CHUNK, [&chunks](const std::vector<std::byte> &pcm) {
+                    chunks.emplace_back(pcm);
+                });
+            });
+        }
+        if(matches_filter(options, "decode", sound.name)) {
+            report.add("stage", "decode", sound.name, BenchUnit::BENCH_UNIT_SAMPLES, sound.sample_count, decode_seconds);
+        }
+
+        if(matches_filter(options, "adpcm-encode", sound.name)) {
+            report.add("stage", "adpcm-encode", sound.name, BenchUnit::BENCH_UNIT_SAMPLES, sound.sample_count, time_seconds([&]() {
+                for(auto &chunk : chunks) {
+                    SoundEncoder::encode_to_xbox_adpcm(chunk, 16, channel_count);
+                }
+            }));
+        }
+
+        // Our own encoder, once per kernel the CPU can run
+        std::vector<std::vector<std::byte>> scalar_output;
+        for(std::size_t k = 0; k < LastResort::AdpcmKernel::ADPCM_KERNEL_COUNT; k++) {
+            auto kernel = static_cast<LastResort::AdpcmKernel>(k);
+            auto stage_name = std::string("adpcm-encode-") + LastResort::adpcm_kernel_name(kernel);
+            if(!LastResort::adpcm_kernel_supported(kernel) || !matches_filter(options, stage_name.c_str(), sound.name)) {
+                continue;
+            }
+
+            std::vector<std::vector<std::byte>> output(chunks.size());
+            for(std::size_t c = 0; c < chunks.size(); c++) {
+                output[c].resize(LastResort::xbox_adpcm_size(chunks[c].size() / (channel_count * sizeof(std::int16_t)), channel_count));
+            }
+            report.add("stage", stage_name, sound.name, BenchUnit::BENCH_UNIT_SAMPLES, sound.sample_count, time_seconds([&]() {
+                for(std::size_t c = 0; c < chunks.size(); c++) {
+                    LastResort::encode_xbox_adpcm_with_kernel(chunks[c].data(), chunks[c].size() / (channel_count * sizeof(std::int16_t)), channel_count, false, output[c].data(), kernel);
+                }
+            }));
+
+            // Every kernel has to match the scalar one exactly, including when it reads big endian samples
+            if(i == 0) {
+                if(kernel == LastResort::AdpcmKernel::ADPCM_KERNEL_SCALAR) {
+                    scalar_output = output;
+                }
+                else if(!scalar_output.empty()) {
+                    report.check(stage_name + "-matches-scalar", sound.name, output == scalar_output);
+                }
+
+                bool big_endian_matches = true;
+                for(std::size_t c = 0; c < chunks.size(); c++) {
+                    std::vector<std::byte> swapped(chunks[c].size());
+                    for(std::size_t b = 0; b + 1 < swapped.size(); b += 2) {
+                        swapped[b] = chunks[c][b + 1];
+                        swapped[b + 1] = chunks[c][b];
+                    }
+                    std::vector<std::byte> big_endian_output(output[c].size());
+                    LastResort::encode_xbox_adpcm_with_kernel(swapped.data(), swapped.size() / (channel_count * sizeof(std::int16_t)), channel_count, true, big_endian_output.data(), kernel);
+                    big_endian_matches = big_endian_matches && big_endian_output == output[c];
+                }
+                report.check(stage_name + "-big-endian", sound.name, big_endian_matches);
+            }
+        }
+    }
+}
+
+// Mipmap generation and tiled encoding assume cube maps are stored level by level, with all six faces in each level.
+// Hold that to what Invader's encoder does by encoding a whole cube map and comparing each level and face with that face
+// encoded on its own, then make sure generating the cube's mipmaps is the same as doing each face on its own.
+static void check_cube_map_layout(BenchReport &report, const BenchOptions &options) {
+    using namespace Invader;
+    using namespace LastResort;
+
+    if(!matches_filter(options, "cube-map-layout", "cube")) {
+        return;
+    }
+
+    static constexpr const std::size_t size = 64;
+    static constexpr const std::size_t faces = 6;
+    auto cube = HEK::BitmapDataType::BITMAP_DATA_TYPE_CUBE_MAP;
+    auto flat = HEK::BitmapDataType::BITMAP_DATA_TYPE_2D_TEXTURE;
+    auto a8r8g8b8 = HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8;
+    auto dxt1 = HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_DXT1;
+    std::size_t mipmap_count = full_mipmap_count(size, size, 1, cube);
+
+    // Noise, so any block that takes pixels from the wrong place encodes differently
+    std::vector<Pixel> chain(mipmap_chain_pixel_count(size, size, 1, cube, mipmap_count));
+    std::uint32_t state = 0x12345678;
+    for(auto &pixel : chain) {
+        state = state * 1664525 + 1013904223;
+        std::memcpy(&pixel, &state, sizeof(pixel));
+    }
+
+    auto encoded = BitmapEncode::encode_bitmap(reinterpret_cast<const std::byte *>(chain.data()), a8r8g8b8, dxt1, size, size, 1, cube, mipmap_count);
+    bool invader_layout_matches = encoded.size() == BitmapEncode::bitmap_data_size(size, size, 1, mipmap_count, dxt1, cube);
+    std::size_t first_pixel = 0;
+    for(std::size_t m = 0, level_size = size; m <= mipmap_count && invader_layout_matches; m++, level_size = std::max<std::size_t>(level_size / 2, 1)) {
+        std::size_t output_offset = m == 0 ? 0 : BitmapEncode::bitmap_data_size(size, size, 1, m - 1, dxt1, cube);
+        for(std::size_t f = 0; f < faces; f++) {
+            auto face = BitmapEncode::encode_bitmap(reinterpret_cast<const std::byte *>(chain.data() + first_pixel + f * level_size * level_size), a8r8g8b8, dxt1, level_size, level_size, 1, flat, 0);
+            std::size_t face_offset = output_offset + f * face.size();
+            invader_layout_matches = invader_layout_matches && face_offset + face.size() <= encoded.size() && std::memcmp(encoded.data() + face_offset, face.data(), face.size()) == 0;
+        }
+        first_pixel += level_size * level_size * faces;
+    }
+    report.check("cube-map-layout-invader", "cube", invader_layout_matches);
+
+    // Now our own mipmaps, face by face
+    generate_mipmap_chain(chain.data(), size, size, 1, cube, mipmap_count, false);
+    bool mipmaps_match = true;
+    for(std::size_t f = 0; f < faces; f++) {
+        std::vector<Pixel> face(mipmap_chain_pixel_count(size, size, 1, flat, mipmap_count));
+        std::copy(chain.begin() + f * size * size, chain.begin() + (f + 1) * size * size, face.begin());
+        generate_mipmap_chain(face.data(), size, size, 1, flat, mipmap_count, false);
+
+        std::size_t cube_level = 0, face_level = 0;
+        for(std::size_t m = 0, level_size = size; m <= mipmap_count; m++, level_size = std::max<std::size_t>(level_size / 2, 1)) {
+            std::size_t level_pixels = level_size * level_size;
+            mipmaps_match = mipmaps_match && std::memcmp(chain.data() + cube_level + f * level_pixels, face.data() + face_level, level_pixels * sizeof(Pixel)) == 0;
+            cube_level += level_pixels * faces;
+            face_level += level_pixels;
+        }
+    }
+    report.check("cube-map-layout-mipmaps", "cube", mipmaps_match);
+}
+
+// The HUD meter swap kernels do convert_to_y8() themselves, so make sure they agree with it on every color
+static void check_luminance_weights(BenchReport &report, const BenchOptions &options) {
+    using namespace LastResort;
+
+    if(!matches_filter(options, "luminance", "all-colors")) {
+        return;
+    }
+    auto &weights = get_luminance_weights();
+    report.check("luminance-weights", "all-colors", weights.has_value());
+    if(!weights.has_value()) {
+        return;
+    }
+
+    // Every RGB value once, with the alpha varying too
+    static constexpr const std::size_t color_count = 1 << 24;
+    std::vector<Invader::Pixel> colors(color_count), reference(color_count);
+    for(std::size_t c = 0; c < color_count; c++) {
+        auto &pixel = colors[c];
+        pixel.blue = static_cast<std::uint8_t>(c);
+        pixel.green = static_cast<std::uint8_t>(c >> 8);
+        pixel.red = static_cast<std::uint8_t>(c >> 16);
+        pixel.alpha = static_cast<std::uint8_t>(c * 0x9E3779B1U >> 24);
+
+        auto &swapped = reference[c];
+        swapped.alpha = pixel.convert_to_y8();
+        swapped.red = pixel.alpha;
+        swapped.green = pixel.alpha;
+        swapped.blue = pixel.alpha;
+    }
+
+    for(std::size_t k = 0; k < SwizzleKernel::SWIZZLE_KERNEL_COUNT; k++) {
+        auto kernel = static_cast<SwizzleKernel>(k);
+        if(!swizzle_kernel_supported(kernel)) {
+            continue;
+        }
+        auto output = colors;
+        hud_meter_swap_pixels_with_kernel(output.data(), output.size(), *weights, kernel);
+        report.check(std::string("luminance-") + swizzle_kernel_name(kernel), "all-colors", std::memcmp(output.data(), reference.data(), color_count * sizeof(Invader::Pixel)) == 0);
+    }
+}
+
+int main(int argc, const char **argv) {
+    using namespace Invader;
+
+    BenchOptions bench_options;
+
+    std::vector<CommandLineOption> options;
+    options.emplace_back("iterations", 'i', 1, "Set the number of times to run each benchmark. The best and mean times are reported. By default, this is 3.", "<count>");
+    options.emplace_back("threads", 'j', 1, "Set the number of threads to use. By default, this is the number of CPU threads.", "<count>");
+    options.emplace_back("scale", 's', 1, "Scale the size of the synthetic bitmaps and the length of the synthetic sounds. By default, this is 1.", "<factor>");
+    options.emplace_back("filter", 'f', 1, "Only run benchmarks whose action, stage, or tag name contains this text.", "<text>");
+    options.emplace_back("output", 'o', 1, "Write the report to this file instead of standard output.", "<file>");
+
+    static constexpr char DESCRIPTION[] = "Measure the throughput of each action and stage on a generated set of bitmap and sound tags. The report is written as JSON.";
+    static constexpr char USAGE[] = "[options]";
+
+    CommandLineOption::parse_arguments<BenchOptions &>(argc, argv, options, USAGE, DESCRIPTION, 0, 0, bench_options, [](char opt, const auto &arguments, auto &bench_options) {
+        switch(opt) {
+            case 'i':
+            case 'j': {
+                char *end = nullptr;
+                auto value = std::strtoul(arguments[0], &end, 10);
+                if(*arguments[0] == 0 || *end != 0 || value == 0) {
+                    eprintf_error("Invalid count: %s", arguments[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                (opt == 'i' ? bench_options.iterations : bench_options.threads) = value;
+                break;
+            }
+            case 's': {
+                char *end = nullptr;
+                auto value = std::strtod(arguments[0], &end);
+                if(*arguments[0] == 0 || *end != 0 || !(value > 0.0)) {
+                    eprintf_error("Invalid scale: %s", arguments[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                bench_options.scale = value;
+                break;
+            }
+            case 'f':
+                bench_options.filter = arguments[0];
+                break;
+            case 'o':
+                bench_options.output = arguments[0];
+                break;
+            default:
+                break;
+        }
+    });
+
+    LastResort::set_thread_count(bench_options.threads);
+
+    // The actions report their progress on standard output, so keep that away from the report
+    std::FILE *report_file;
+    if(bench_options.output) {
+        report_file = std::fopen(bench_options.output, "w");
+        if(!report_file) {
+            eprintf_error("Failed to open %s", bench_options.output);
+            return EXIT_FAILURE;
+        }
+    }
+    else {
+        report_file = fdopen(dup(STDOUT_FILENO), "w");
+    }
+    std::fflush(stdout);
+    if(!std::freopen("/dev/null", "w", stdout)) {
+        eprintf_warn("Failed to silence standard output");
+    }
+
+    BenchReport report;
+    check_luminance_weights(report, bench_options);
+    check_cube_map_layout(report, bench_options);
+
+    for(auto &bitmap : LastResort::Bench::make_bitmap_corpus(bench_options.scale)) {
+        bench_bitmap_actions(report, bench_options, bitmap);
+        bench_bitmap_stages(report, bench_options, bitmap);
+    }
+
+    for(auto &sound : LastResort::Bench::make_sound_corpus(bench_options.scale)) {
+        bench_sound_actions(report, bench_options, sound);
+        bench_sound_stages(report, bench_options, sound);
+    }
+
+    report.write_json(report_file, bench_options);
+    std::fclose(report_file);
+
+    return report.all_checks_passed() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
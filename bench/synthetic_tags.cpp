@@ -0,0 +1,278 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <invader/tag/parser/parser.hpp>
+#include <invader/sound/sound_encoder.hpp>
+#include <invader/bitmap/pixel.hpp>
+#include <invader/bitmap/bitmap_encode.hpp>
+
+#include "synthetic_tags.hpp"
+#include "../src/mipmap.hpp"
+
+namespace LastResort::Bench {
+    // Small deterministic generator so the corpus is the same on every machine
+    static std::uint32_t next_random(std::uint32_t &state) noexcept {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    static const char *type_name(Invader::HEK::BitmapDataType type) noexcept {
+        switch(type) {
+            case Invader::HEK::BitmapDataType::BITMAP_DATA_TYPE_3D_TEXTURE:
+                return "3d";
+            case Invader::HEK::BitmapDataType::BITMAP_DATA_TYPE_CUBE_MAP:
+                return "cube";
+            default:
+                return "2d";
+        }
+    }
+
+    static const char *format_name(Invader::HEK::BitmapDataFormat format) noexcept {
+        switch(format) {
+            case Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_DXT1:
+                return "dxt1";
+            case Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_DXT3:
+                return "dxt3";
+            case Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_DXT5:
+                return "dxt5";
+            case Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_P8_BUMP:
+                return "p8";
+            case Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_X8R8G8B8:
+                return "x8r8g8b8";
+            case Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8:
+                return "a8r8g8b8";
+            default:
+                return "other";
+        }
+    }
+
+    static void set_tag_string(Invader::Parser::TagString &string, const char *value) noexcept {
+        std::memset(string.string, 0, sizeof(string.string));
+        std::strncpy(string.string, value, sizeof(string.string) - 1);
+    }
+
+    SyntheticBitmap make_synthetic_bitmap(std::size_t width, std::size_t height, std::size_t depth, Invader::HEK::BitmapDataType type, Invader::HEK::BitmapDataFormat format, std::size_t mipmap_count, std::uint32_t seed) {
+        using namespace Invader::HEK;
+
+        if(type != BitmapDataType::BITMAP_DATA_TYPE_3D_TEXTURE) {
+            depth = 1;
+        }
+        if(!can_generate_mipmaps(type, depth)) {
+            mipmap_count = 0;
+        }
+        mipmap_count = std::min(mipmap_count, full_mipmap_count(width, height, depth, type));
+
+        // Fill the base level with gradients and a bit of noise so compressors have something realistic to chew on
+        auto pixel_count = mipmap_chain_pixel_count(width, height, depth, type, mipmap_count);
+        std::vector<Invader::Pixel> pixels(pixel_count);
+        std::size_t layers = type == BitmapDataType::BITMAP_DATA_TYPE_CUBE_MAP ? 6 : depth;
+        std::uint32_t state = seed | 1;
+        auto *pixel = pixels.data();
+        for(std::size_t z = 0; z < layers; z++) {
+            for(std::size_t y = 0; y < height; y++) {
+                for(std::size_t x = 0; x < width; x++, pixel++) {
+                    auto noise = next_random(state);
+                    pixel->red = static_cast<std::uint8_t>(x * 256 / width + (noise & 0xF));
+                    pixel->green = static_cast<std::uint8_t>(y * 256 / height + ((noise >> 4) & 0xF));
+                    pixel->blue = static_cast<std::uint8_t>(z * 37 + ((x ^ y) & 0x3F) + ((noise >> 8) & 0x7));
+                    pixel->alpha = static_cast<std::uint8_t>(((x / 8 + y / 8) & 1) ? 0xFF - ((noise >> 24) & 0x1F) : (x + y) * 128 / (width + height));
+                }
+            }
+        }
+        if(mipmap_count > 0) {
+            generate_mipmap_chain(pixels.data(), width, height, depth, type, mipmap_count, false);
+        }
+
+        Invader::Parser::Bitmap bitmap = {};
+        auto &data = bitmap.bitmap_data.emplace_back();
+        data.bitmap_class = TagFourCC::TAG_FOURCC_BITMAP;
+        data.width = static_cast<std::uint16_t>(width);
+        data.height = static_cast<std::uint16_t>(height);
+        data.depth = static_cast<std::uint16_t>(depth);
+        data.type = type;
+        data.format = format;
+        data.mipmap_count = static_cast<std::uint16_t>(mipmap_count);
+        data.pixel_data_offset = 0;
+        data.flags = 0;
+        if((width & (width - 1)) == 0 && (height & (height - 1)) == 0 && (depth & (depth - 1)) == 0) {
+            data.flags |= BitmapDataFlagsFlag::BITMAP_DATA_FLAGS_FLAG_POWER_OF_TWO_DIMENSIONS;
+        }
+        if(format == BitmapDataFormat::BITMAP_DATA_FORMAT_DXT1 || format == BitmapDataFormat::BITMAP_DATA_FORMAT_DXT3 || format == BitmapDataFormat::BITMAP_DATA_FORMAT_DXT5) {
+            data.flags |= BitmapDataFlagsFlag::BITMAP_DATA_FLAGS_FLAG_COMPRESSED;
+        }
+        if(format == BitmapDataFormat::BITMAP_DATA_FORMAT_P8_BUMP) {
+            data.flags |= BitmapDataFlagsFlag::BITMAP_DATA_FLAGS_FLAG_PALETTIZED;
+        }
+        bitmap.processed_pixel_data = Invader::BitmapEncode::encode_bitmap(reinterpret_cast<const std::byte *>(pixels.data()), BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8, format, width, height, depth, type, mipmap_count);
+
+        SyntheticBitmap result;
+        result.name = std::string(type_name(type)) + "-" + std::to_string(width) + "x" + std::to_string(height);
+        if(type == BitmapDataType::BITMAP_DATA_TYPE_3D_TEXTURE) {
+            result.name += "x" + std::to_string(depth);
+        }
+        result.name += std::string("-") + format_name(format) + (mipmap_count > 0 ? "-mipmapped" : "");
+        result.tag_data = bitmap.generate_hek_tag_data(TagFourCC::TAG_FOURCC_BITMAP);
+        result.pixel_count = pixel_count;
+        return result;
+    }
+
+    SyntheticSound make_synthetic_sound(Invader::HEK::SoundFormat format, std::size_t channels, std::size_t sample_rate, double seconds, bool split, std::uint32_t seed) {
+        using namespace Invader::HEK;
+
+        static constexpr const std::size_t permutation_count = 2;
+        static constexpr const std::size_t frames_per_split_piece = 65536;
+        static constexpr const double pi = 3.14159265358979323846;
+        auto frame_count = std::max<std::size_t>(static_cast<std::size_t>(seconds * sample_rate), 1);
+        std::uint32_t state = seed | 1;
+
+        Invader::Parser::Sound sound = {};
+        sound.format = format;
+        sound.channel_count = channels == 1 ? SoundChannelCount::SOUND_CHANNEL_COUNT_MONO : SoundChannelCount::SOUND_CHANNEL_COUNT_STEREO;
+        sound.sample_rate = sample_rate == 44100 ? SoundSampleRate::SOUND_SAMPLE_RATE_44100_HZ : SoundSampleRate::SOUND_SAMPLE_RATE_22050_HZ;
+        sound.flags = 0;
+        if(split) {
+            sound.flags |= SoundFlagsFlag::SOUND_FLAGS_FLAG_SPLIT_LONG_SOUND_INTO_PERMUTATIONS;
+        }
+
+        auto &pitch_range = sound.pitch_ranges.emplace_back();
+        set_tag_string(pitch_range.name, "default");
+        pitch_range.natural_pitch = 1.0F;
+        pitch_range.actual_permutation_count = permutation_count;
+        pitch_range.permutations.resize(permutation_count);
+
+        for(std::size_t p = 0; p < permutation_count; p++) {
+            // A couple of tones with some noise on top, in little endian 16-bit PCM
+            std::vector<std::byte> pcm(frame_count * channels * sizeof(std::int16_t));
+            auto *sample = reinterpret_cast<std::uint8_t *>(pcm.data());
+            for(std::size_t f = 0; f < frame_count; f++) {
+                for(std::size_t c = 0; c < channels; c++) {
+                    double t = static_cast<double>(f) / sample_rate;
+                    double value = 0.4 * std::sin(2.0 * pi * (220.0 * (p + 1) + 110.0 * c) * t) + 0.2 * std::sin(2.0 * pi * 1375.0 * t) + 0.05 * (static_cast<double>(next_random(state) & 0xFFFF) / 32768.0 - 1.0);
+                    auto value_int = static_cast<std::uint16_t>(static_cast<std::int16_t>(value * 32767.0));
+                    *(sample++) = static_cast<std::uint8_t>(value_int);
+                    *(sample++) = static_cast<std::uint8_t>(value_int >> 8);
+                }
+            }
+
+            // Split it into pieces if requested, each of which is encoded on its own
+            std::size_t frames_per_piece = split ? frames_per_split_piece : frame_count;
+            std::size_t bytes_per_frame = channels * sizeof(std::int16_t);
+            std::size_t previous = p;
+            for(std::size_t first_frame = 0; first_frame < frame_count; first_frame += frames_per_piece) {
+                auto piece_frames = std::min(frames_per_piece, frame_count - first_frame);
+                std::vector<std::byte> piece(pcm.begin() + first_frame * bytes_per_frame, pcm.begin() + (first_frame + piece_frames) * bytes_per_frame);
+
+                Invader::Parser::SoundPermutation *permutation;
+                if(first_frame == 0) {
+                    permutation = &pitch_range.permutations[p];
+                }
+                else {
+                    pitch_range.permutations[previous].next_permutation_index = static_cast<std::uint16_t>(pitch_range.permutations.size());
+                    previous = pitch_range.permutations.size();
+                    permutation = &pitch_range.permutations.emplace_back();
+                }
+
+                set_tag_string(permutation->name, ("permutation " + std::to_string(p)).c_str());
+                permutation->gain = 1.0F;
+                permutation->skip_fraction = 0.0F;
+                permutation->format = format;
+                permutation->next_permutation_index = NULL_INDEX;
+
+                if(format == SoundFormat::SOUND_FORMAT_OGG_VORBIS) {
+                    permutation->buffer_size = static_cast<std::uint32_t>(piece.size());
+                    permutation->samples = Invader::SoundEncoder::encode_to_ogg_vorbis(piece, 16, channels, sample_rate, 0.5F);
+                }
+                else {
+                    // Tags store PCM as big endian
+                    for(std::size_t b = 0; b + 1 < piece.size(); b += 2) {
+                        std::swap(piece[b], piece[b + 1]);
+                    }
+                    permutation->buffer_size = 0;
+                    permutation->samples = std::move(piece);
+                }
+            }
+        }
+
+        SyntheticSound result;
+        result.name = std::string(format == SoundFormat::SOUND_FORMAT_OGG_VORBIS ? "ogg" : "pcm") + (channels == 1 ? "-mono" : "-stereo") + (sample_rate == 44100 ? "-44khz" : "-22khz") + (split ? "-split" : "");
+        result.tag_data = sound.generate_hek_tag_data(TagFourCC::TAG_FOURCC_SOUND);
+        result.sample_count = frame_count * permutation_count;
+        return result;
+    }
+
+    static std::size_t scale_dimension(std::size_t size, double scale) noexcept {
+        auto scaled = static_cast<std::size_t>(size * scale);
+        std::size_t power_of_two = 4;
+        while(power_of_two * 2 <= scaled) {
+            power_of_two *= 2;
+        }
+        return power_of_two;
+    }
+
+    std::vector<SyntheticBitmap> make_bitmap_corpus(double scale) {
+        using namespace Invader::HEK;
+
+        struct Spec {
+            std::size_t width, height, depth;
+            BitmapDataType type;
+            BitmapDataFormat format;
+            bool mipmaps;
+        };
+
+        static constexpr const Spec specs[] = {
+            { 1024, 1024, 1, BitmapDataType::BITMAP_DATA_TYPE_2D_TEXTURE, BitmapDataFormat::BITMAP_DATA_FORMAT_DXT1, true },
+            { 1024, 1024, 1, BitmapDataType::BITMAP_DATA_TYPE_2D_TEXTURE, BitmapDataFormat::BITMAP_DATA_FORMAT_DXT3, true },
+            { 1024, 1024, 1, BitmapDataType::BITMAP_DATA_TYPE_2D_TEXTURE, BitmapDataFormat::BITMAP_DATA_FORMAT_DXT5, true },
+            { 1024, 1024, 1, BitmapDataType::BITMAP_DATA_TYPE_2D_TEXTURE, BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8, true },
+            { 512, 512, 1, BitmapDataType::BITMAP_DATA_TYPE_2D_TEXTURE, BitmapDataFormat::BITMAP_DATA_FORMAT_P8_BUMP, true },
+            { 256, 256, 1, BitmapDataType::BITMAP_DATA_TYPE_2D_TEXTURE, BitmapDataFormat::BITMAP_DATA_FORMAT_X8R8G8B8, false },
+            { 256, 256, 1, BitmapDataType::BITMAP_DATA_TYPE_CUBE_MAP, BitmapDataFormat::BITMAP_DATA_FORMAT_DXT1, true },
+            { 256, 256, 1, BitmapDataType::BITMAP_DATA_TYPE_CUBE_MAP, BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8, true },
+            { 64, 64, 64, BitmapDataType::BITMAP_DATA_TYPE_3D_TEXTURE, BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8, true },
+            { 32, 32, 32, BitmapDataType::BITMAP_DATA_TYPE_3D_TEXTURE, BitmapDataFormat::BITMAP_DATA_FORMAT_X8R8G8B8, false }
+        };
+
+        std::vector<SyntheticBitmap> corpus;
+        std::uint32_t seed = 1;
+        for(auto &spec : specs) {
+            auto width = scale_dimension(spec.width, scale);
+            auto height = scale_dimension(spec.height, scale);
+            auto depth = spec.type == BitmapDataType::BITMAP_DATA_TYPE_3D_TEXTURE ? scale_dimension(spec.depth, scale) : 1;
+            corpus.emplace_back(make_synthetic_bitmap(width, height, depth, spec.type, spec.format, spec.mipmaps ? full_mipmap_count(width, height, depth, spec.type) : 0, seed++));
+        }
+        return corpus;
+    }
+
+    std::vector<SyntheticSound> make_sound_corpus(double scale) {
+        using namespace Invader::HEK;
+
+        struct Spec {
+            SoundFormat format;
+            std::size_t channels;
+            std::size_t sample_rate;
+            bool split;
+        };
+
+        static constexpr const Spec specs[] = {
+            { SoundFormat::SOUND_FORMAT_16_BIT_PCM, 1, 22050, false },
+            { SoundFormat::SOUND_FORMAT_16_BIT_PCM, 1, 44100, true },
+            { SoundFormat::SOUND_FORMAT_16_BIT_PCM, 2, 44100, true },
+            { SoundFormat::SOUND_FORMAT_OGG_VORBIS, 1, 22050, true },
+            { SoundFormat::SOUND_FORMAT_OGG_VORBIS, 2, 22050, false },
+            { SoundFormat::SOUND_FORMAT_OGG_VORBIS, 2, 44100, false }
+        };
+
+        static constexpr const double seconds = 8.0;
+
+        std::vector<SyntheticSound> corpus;
+        std::uint32_t seed = 1000;
+        for(auto &spec : specs) {
+            corpus.emplace_back(make_synthetic_sound(spec.format, spec.channels, spec.sample_rate, seconds * scale, spec.split, seed++));
+        }
+        return corpus;
+    }
+}
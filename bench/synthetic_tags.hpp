@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__BENCH__SYNTHETIC_TAGS_HPP
+#define LAST_RESORT__BENCH__SYNTHETIC_TAGS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <invader/tag/hek/definition.hpp>
+
+namespace LastResort::Bench {
+    struct SyntheticBitmap {
+        /** Name of the bitmap, used in reports */
+        std::string name;
+
+        /** Tag data, including the tag file header */
+        std::vector<std::byte> tag_data;
+
+        /** Number of pixels in every bitmap data, including mipmaps */
+        std::size_t pixel_count;
+    };
+
+    struct SyntheticSound {
+        /** Name of the sound, used in reports */
+        std::string name;
+
+        /** Tag data, including the tag file header */
+        std::vector<std::byte> tag_data;
+
+        /** Number of sample frames in every permutation */
+        std::size_t sample_count;
+    };
+
+    /**
+     * Generate a bitmap tag with a single bitmap data of noisy gradients
+     * @param width        width in pixels
+     * @param height       height in pixels
+     * @param depth        depth in pixels (1 unless this is a 3D texture)
+     * @param type         bitmap type
+     * @param format       bitmap format
+     * @param mipmap_count number of mipmaps
+     * @param seed         seed for the noise
+     * @return             bitmap tag
+     */
+    SyntheticBitmap make_synthetic_bitmap(std::size_t width, std::size_t height, std::size_t depth, Invader::HEK::BitmapDataType type, Invader::HEK::BitmapDataFormat format, std::size_t mipmap_count, std::uint32_t seed);
+
+    /**
+     * Generate a sound tag with two permutations of tones and noise
+     * @param format      sound format (16-bit PCM or Ogg Vorbis)
+     * @param channels    number of channels (1 or 2)
+     * @param sample_rate sample rate in Hz (22050 or 44100)
+     * @param seconds     length of each permutation in seconds
+     * @param split       split each permutation into a chain of shorter permutations like Guerilla's "split long sound into permutations"
+     * @param seed        seed for the noise
+     * @return            sound tag
+     */
+    SyntheticSound make_synthetic_sound(Invader::HEK::SoundFormat format, std::size_t channels, std::size_t sample_rate, double seconds, bool split, std::uint32_t seed);
+
+    /**
+     * Generate the standard set of bitmap tags, covering every format and type the actions handle
+     * @param scale size multiplier for each bitmap's width and height (1 = full size)
+     * @return      bitmap tags
+     */
+    std::vector<SyntheticBitmap> make_bitmap_corpus(double scale);
+
+    /**
+     * Generate the standard set of sound tags, covering PCM and Ogg, mono and stereo, 22 and 44 kHz, and split and unsplit
+     * @param scale length multiplier for each sound (1 = full length)
+     * @return      sound tags
+     */
+    std::vector<SyntheticSound> make_sound_corpus(double scale);
+}
+
+#endif
@@ -0,0 +1,609 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <invader/tag/parser/parser.hpp>
+#include <invader/sound/sound_encoder.hpp>
+#include <invader/bitmap/pixel.hpp>
+#include <invader/bitmap/bitmap_encode.hpp>
+#include <algorithm>
+#include <limits>
+
+#include "actions.hpp"
+#include "buffer_pool.hpp"
+#include "diagnostics.hpp"
+#include "error.hpp"
+#include "parallel.hpp"
+#include "swizzle.hpp"
+#include "mipmap.hpp"
+#include "pixel_stats.hpp"
+#include "result_memo.hpp"
+#include "dxt_swizzle.hpp"
+#include "sound_stream.hpp"
+#include "stats.hpp"
+#include "tiled_encode.hpp"
+#include "xbox_adpcm.hpp"
+
+namespace LastResort {
+    // A converted bitmap data along with every field the conversion changed
+    struct ConvertedBitmapData {
+        std::vector<std::byte> data;
+        decltype(Invader::Parser::BitmapData::format) format;
+        decltype(Invader::Parser::BitmapData::flags) flags;
+        decltype(Invader::Parser::BitmapData::mipmap_count) mipmap_count;
+        std::string format_report;
+    };
+
+    // With reuse_results, converted data is remembered for the whole process since mods often have the same bitmaps and
+    // sounds in many tags
+    static constexpr const std::size_t memo_max_bytes = 128 * 1024 * 1024;
+
+    static ResultMemo<ConvertedBitmapData> &bitmap_memo() noexcept {
+        static ResultMemo<ConvertedBitmapData> memo(memo_max_bytes);
+        return memo;
+    }
+
+    static ResultMemo<std::vector<std::vector<std::byte>>> &sound_memo() noexcept {
+        static ResultMemo<std::vector<std::vector<std::byte>>> memo(memo_max_bytes);
+        return memo;
+    }
+
+    void clear_conversion_memo() noexcept {
+        bitmap_memo().clear();
+        sound_memo().clear();
+    }
+
+    // Copy a remembered buffer into one from the pool so it can be handed off like a newly converted one
+    static std::vector<std::byte> copy_memoized_data(const std::vector<std::byte> &data) {
+        auto copy = BufferPool::shared().acquire(data.size());
+        copy.assign(data.begin(), data.end());
+        return copy;
+    }
+
+    // Convert a single bitmap data, returning its new pixel data; if a format was chosen from a format class, format_report explains the choice
+    template <typename F> static std::vector<std::byte> process_bitmap_data(const std::byte *data, Invader::Parser::BitmapData &i, const BitmapOptions &options, const F &modify_pixel, std::string &format_report) {
+        bool should_regenerate_mipmaps = options.generate_mipmaps && LastResort::can_generate_mipmaps(i.type, i.depth);
+
+        // If we're just moving channels around and not changing the format, we may not need to decode anything
+        auto &shuffle = LastResort::get_pixel_shuffle(modify_pixel);
+        if(shuffle.has_value() && !options.force_format.has_value() && !options.generate_mipmaps) {
+            auto size_of_bitmap = Invader::BitmapEncode::bitmap_data_size(i.width, i.height, i.depth, i.mipmap_count, i.format, i.type);
+            auto new_data = BufferPool::shared().acquire(size_of_bitmap);
+            new_data.assign(data, data + size_of_bitmap);
+
+            // Nothing to do at all
+            if(shuffle->is_identity()) {
+                return new_data;
+            }
+
+            // Rewrite the DXT blocks directly if every block can be done exactly
+            if(LastResort::is_dxt_format(i.format)) {
+                StageTimer timer(Stage::STAGE_DXT_SHUFFLE, new_data.size(), mipmap_chain_pixel_count(i.width, i.height, i.depth, i.type, i.mipmap_count));
+                if(LastResort::shuffle_dxt_blocks(new_data.data(), new_data.size(), i.format, *shuffle)) {
+                    return new_data;
+                }
+            }
+            BufferPool::shared().release(std::move(new_data));
+        }
+
+        // If regenerate mipmaps, reduce mipmap count to 0
+        if(should_regenerate_mipmaps) {
+            i.mipmap_count = 0;
+        }
+
+        // Get it!
+        std::vector<std::byte> new_data;
+        {
+            auto input_size = Invader::BitmapEncode::bitmap_data_size(i.width, i.height, i.depth, i.mipmap_count, i.format, i.type);
+            StageTimer timer(Stage::STAGE_BITMAP_DECODE, input_size, mipmap_chain_pixel_count(i.width, i.height, i.depth, i.type, i.mipmap_count));
+            new_data = Invader::BitmapEncode::encode_bitmap(data, i.format, Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8, i.width, i.height, i.depth, i.type, i.mipmap_count);
+        }
+
+        // Go through each pixel, splitting big bitmaps (especially cube maps and 3D textures) across threads
+        auto *first_pixel = reinterpret_cast<Invader::Pixel *>(new_data.data());
+        std::size_t pixel_count = new_data.size() / sizeof(*first_pixel);
+        static constexpr const std::size_t pixels_per_job = 65536;
+        std::size_t job_count = (pixel_count + pixels_per_job - 1) / pixels_per_job;
+
+        // If we need to pick a format, look at the base level while each job's pixels are still in cache. Format
+        // selection is done on the swizzled pixels since those are what actually get encoded.
+        auto *force_format_class = options.force_format.has_value() ? std::get_if<Invader::HEK::BitmapFormat>(&*options.force_format) : nullptr;
+        bool gather_luminance = force_format_class && format_class_needs_luminance(*force_format_class);
+        std::size_t base_pixel_count = force_format_class ? std::min(pixel_count, mipmap_chain_pixel_count(i.width, i.height, i.depth, i.type, 0)) : 0;
+        std::vector<PixelStats> job_stats(force_format_class ? job_count : 0);
+
+        StageTimer swizzle_timer(Stage::STAGE_SWIZZLE, new_data.size(), pixel_count);
+        LastResort::parallel_for(job_count, [&first_pixel, &pixel_count, &modify_pixel, &base_pixel_count, &job_stats, &gather_luminance](std::size_t job) {
+            auto first_job_pixel = job * pixels_per_job;
+            auto job_pixel_count = std::min(pixel_count - first_job_pixel, pixels_per_job);
+            LastResort::swizzle_pixels(first_pixel + first_job_pixel, job_pixel_count, modify_pixel);
+            if(first_job_pixel < base_pixel_count) {
+                job_stats[job].add(first_pixel + first_job_pixel, std::min(job_pixel_count, base_pixel_count - first_job_pixel), gather_luminance);
+            }
+        });
+        swizzle_timer.finish();
+
+        // Figure out the bitmap to force it to if we need to force the bitmap
+        if(options.force_format.has_value()) {
+            if(force_format_class) {
+                StageTimer timer(Stage::STAGE_FORMAT_SELECTION, 0, base_pixel_count);
+                PixelStats stats;
+                for(auto &j : job_stats) {
+                    stats.merge(j);
+                }
+                std::string reason;
+                i.format = choose_bitmap_format(stats, *force_format_class, reason);
+                format_report = std::string(Invader::HEK::BitmapDataFormat_to_string(i.format)) + " (" + reason + ")";
+            }
+            else {
+                i.format = std::get<Invader::HEK::BitmapDataFormat>(*options.force_format);
+            }
+
+            // Set palettized flag if needed
+            if(i.format == Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_P8_BUMP) {
+                i.flags |= Invader::HEK::BitmapDataFlagsFlag::BITMAP_DATA_FLAGS_FLAG_PALETTIZED;
+            }
+            else {
+                i.flags &= ~Invader::HEK::BitmapDataFlagsFlag::BITMAP_DATA_FLAGS_FLAG_PALETTIZED;
+            }
+
+            // Set compressed flag if needed
+            if(i.format == Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_DXT1 || i.format == Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_DXT3 || i.format == Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_DXT5) {
+                i.flags |= Invader::HEK::BitmapDataFlagsFlag::BITMAP_DATA_FLAGS_FLAG_COMPRESSED;
+            }
+            else {
+                i.flags &= ~Invader::HEK::BitmapDataFlagsFlag::BITMAP_DATA_FLAGS_FLAG_COMPRESSED;
+            }
+        }
+
+        // Generate mipmaps, allocating the whole chain once and filling it in place
+        if(should_regenerate_mipmaps) {
+            std::size_t mipmap_count = LastResort::full_mipmap_count(i.width, i.height, i.depth, i.type);
+            auto chain_size = LastResort::mipmap_chain_pixel_count(i.width, i.height, i.depth, i.type, mipmap_count) * sizeof(Invader::Pixel);
+            auto chain = BufferPool::shared().acquire(chain_size);
+            chain.assign(new_data.begin(), new_data.end());
+            chain.resize(chain_size);
+            BufferPool::shared().release(std::move(new_data));
+            new_data = std::move(chain);
+            StageTimer timer(Stage::STAGE_MIPMAPS, new_data.size(), new_data.size() / sizeof(Invader::Pixel));
+            LastResort::generate_mipmap_chain(reinterpret_cast<Invader::Pixel *>(new_data.data()), i.width, i.height, i.depth, i.type, mipmap_count, options.gamma_correct_mipmaps);
+            i.mipmap_count = mipmap_count;
+        }
+
+        // Done; the decoded pixels can go back to the pool for the next bitmap
+        StageTimer timer(Stage::STAGE_BITMAP_ENCODE, new_data.size(), new_data.size() / sizeof(Invader::Pixel));
+        auto encoded = LastResort::encode_bitmap_tiled(reinterpret_cast<const Invader::Pixel *>(new_data.data()), i.format, i.width, i.height, i.depth, i.type, i.mipmap_count, options.dither);
+        BufferPool::shared().release(std::move(new_data));
+        return encoded;
+    }
+
+    // Everything besides the pixel data that affects how a bitmap data is converted
+    static MemoKey bitmap_data_memo_key(const std::byte *data, const Invader::Parser::BitmapData &i, const BitmapOptions &options, LastResortAction action) noexcept {
+        MemoKey key;
+        key.add(data, Invader::BitmapEncode::bitmap_data_size(i.width, i.height, i.depth, i.mipmap_count, i.format, i.type));
+        key.add_value(i.width);
+        key.add_value(i.height);
+        key.add_value(i.depth);
+        key.add_value(i.type);
+        key.add_value(i.format);
+        key.add_value(static_cast<std::uint32_t>(i.flags));
+        key.add_value(i.mipmap_count);
+        key.add_value(action);
+        key.add_value(options.force_format.has_value() ? static_cast<int>(options.force_format->index()) : -1);
+        key.add_value(options.force_format.has_value() ? std::visit([](auto value) { return static_cast<int>(value); }, *options.force_format) : -1);
+        key.add_value(options.dither);
+        key.add_value(options.generate_mipmaps);
+        key.add_value(options.gamma_correct_mipmaps);
+        return key;
+    }
+
+    // Convert a bitmap data, or reuse the result of converting an identical one
+    template <typename F> static std::vector<std::byte> convert_bitmap_data(const std::byte *data, Invader::Parser::BitmapData &i, const BitmapOptions &options, LastResortAction action, const F &modify_pixel, std::string &format_report) {
+        if(options.generate_mipmaps && !LastResort::can_generate_mipmaps(i.type, i.depth)) {
+            report(DiagnosticLevel::DIAGNOSTIC_LEVEL_WARNING, "Unable to regenerate mipmaps for this bitmap type");
+        }
+
+        if(!options.reuse_results) {
+            return process_bitmap_data(data, i, options, modify_pixel, format_report);
+        }
+
+        auto key = bitmap_data_memo_key(data, i, options, action);
+        if(auto converted = bitmap_memo().find(key)) {
+            StageTimer timer(Stage::STAGE_REUSE, converted->data.size(), converted->data.size() / sizeof(Invader::Pixel));
+            i.format = converted->format;
+            i.flags = converted->flags;
+            i.mipmap_count = converted->mipmap_count;
+            format_report = converted->format_report;
+            return copy_memoized_data(converted->data);
+        }
+
+        auto new_data = process_bitmap_data(data, i, options, modify_pixel, format_report);
+        auto size = new_data.size() + format_report.size();
+        bitmap_memo().store(key, size, [&]() {
+            return ConvertedBitmapData { std::vector<std::byte>(new_data.begin(), new_data.end()), i.format, i.flags, i.mipmap_count, format_report };
+        });
+        return new_data;
+    }
+
+    template <typename F> static void iterate_through_bitmap_tag(Invader::Parser::Bitmap *bitmap, const BitmapOptions &options, LastResortAction action, const F &modify_pixel) {
+        if(bitmap == nullptr) {
+            throw WrongTagClassError("Invalid tag provided for this action");
+        }
+
+        // Check everything before doing any work
+        for(auto &i : bitmap->bitmap_data) {
+            auto size_of_bitmap = Invader::BitmapEncode::bitmap_data_size(i.width, i.height, i.depth, i.mipmap_count, i.format, i.type);
+
+            if(i.pixel_data_offset >= bitmap->processed_pixel_data.size() || size_of_bitmap > bitmap->processed_pixel_data.size() || i.pixel_data_offset + size_of_bitmap > bitmap->processed_pixel_data.size()) {
+                throw InvalidTagError("Bitmap tag invalid - bitmap data out of bounds");
+            }
+        }
+
+        // Each bitmap data is independent, so do them all at once
+        auto bitmap_count = bitmap->bitmap_data.size();
+        std::vector<std::vector<std::byte>> new_bitmap_data_entries(bitmap_count);
+        std::vector<std::string> format_reports(bitmap_count);
+        LastResort::parallel_for(bitmap_count, [&bitmap, &new_bitmap_data_entries, &format_reports, &options, &action, &modify_pixel](std::size_t b) {
+            auto &i = bitmap->bitmap_data[b];
+            new_bitmap_data_entries[b] = convert_bitmap_data(bitmap->processed_pixel_data.data() + i.pixel_data_offset, i, options, action, modify_pixel, format_reports[b]);
+        });
+
+        // Then stitch them back together in order
+        std::size_t new_bitmap_data_size = 0;
+        for(auto &i : new_bitmap_data_entries) {
+            new_bitmap_data_size += i.size();
+        }
+
+        // A lone bitmap data can be moved in as-is; otherwise, copy each one in and give it back to the pool
+        auto &pool = BufferPool::shared();
+        std::vector<std::byte> new_bitmap_data;
+        if(bitmap_count == 1) {
+            bitmap->bitmap_data[0].pixel_data_offset = 0;
+            new_bitmap_data = std::move(new_bitmap_data_entries[0]);
+        }
+        else {
+            new_bitmap_data = pool.acquire(new_bitmap_data_size);
+            for(std::size_t b = 0; b < bitmap_count; b++) {
+                bitmap->bitmap_data[b].pixel_data_offset = new_bitmap_data.size();
+                new_bitmap_data.insert(new_bitmap_data.end(), new_bitmap_data_entries[b].begin(), new_bitmap_data_entries[b].end());
+                pool.release(std::move(new_bitmap_data_entries[b]));
+            }
+        }
+
+        // The old pixel data won't be needed again
+        pool.release(std::move(bitmap->processed_pixel_data));
+        bitmap->processed_pixel_data = std::move(new_bitmap_data);
+
+        for(std::size_t b = 0; b < bitmap_count; b++) {
+            if(!format_reports[b].empty()) {
+                report(DiagnosticLevel::DIAGNOSTIC_LEVEL_INFO, "Bitmap data #%zu: %s", b, format_reports[b].c_str());
+            }
+        }
+
+        report(DiagnosticLevel::DIAGNOSTIC_LEVEL_SUCCESS, "Modified %zu bitmap%s", bitmap->bitmap_data.size(), bitmap->bitmap_data.size() == 1 ? "" : "s");
+    }
+
+    // Move the meter into the color channels and the mask into the alpha channel
+    struct HudMeterSwap {
+        void operator()(Invader::Pixel &pixel) const {
+            std::uint8_t mask = pixel.convert_to_y8();
+            std::uint8_t meter = pixel.alpha;
+
+            pixel.alpha = mask;
+            pixel.red = meter;
+            pixel.green = meter;
+            pixel.blue = meter;
+        }
+
+        // Vectorized, if convert_to_y8() turned out to be a weighted sum we can do ourselves
+        void operator()(Invader::Pixel *pixels, std::size_t count) const {
+            auto &weights = LastResort::get_luminance_weights();
+            if(weights.has_value()) {
+                LastResort::hud_meter_swap_pixels(pixels, count, *weights);
+                return;
+            }
+            for(std::size_t i = 0; i < count; i++) {
+                (*this)(pixels[i]);
+            }
+        }
+    };
+
+    void hud_meter_swap(Invader::Parser::Bitmap *bitmap, const BitmapOptions &options) {
+        iterate_through_bitmap_tag(bitmap, options, LastResortAction::LAST_RESORT_ACTION_HUD_METER_SWAP, HudMeterSwap());
+    }
+
+    void multi_gbx_to_xbox(Invader::Parser::Bitmap *bitmap, const BitmapOptions &options) {
+        iterate_through_bitmap_tag(bitmap, options, LastResortAction::LAST_RESORT_ACTION_MULTIPURPOSE_GBX_TO_XBOX, [](Invader::Pixel &pixel) {
+            Invader::Pixel new_pixel;
+            new_pixel.green = pixel.green; // self illumination is passed through
+            new_pixel.alpha = 0xFF; // pixel.red; // auxilary is memed to 0xFF because DXT1                                                                                                           
+            new_pixel.red = pixel.blue; // detail/specular is memed
+            new_pixel.blue = pixel.alpha; // color change is memed 
+            pixel = new_pixel;
+        });
+    }
+
+    void bitmap_passthrough(Invader::Parser::Bitmap *bitmap, const BitmapOptions &options) {
+        iterate_through_bitmap_tag(bitmap, options, LastResortAction::LAST_RESORT_ACTION_BITMAP_PASSTHROUGH, [](Invader::Pixel &) {});
+    }
+
+    void multi_xbox_to_gbx(Invader::Parser::Bitmap *bitmap, const BitmapOptions &options) {
+        iterate_through_bitmap_tag(bitmap, options, LastResortAction::LAST_RESORT_ACTION_MULTIPURPOSE_XBOX_TO_GBX, [](Invader::Pixel &pixel) {
+            Invader::Pixel new_pixel;
+            new_pixel.green = pixel.green; // self illumination is passed through
+            new_pixel.red = 0x00; // pixel.alpha; // auxilary is memed to 0x00
+            new_pixel.blue = pixel.red; // detail/specular is memed
+            new_pixel.alpha = pixel.blue; // color change is memed 
+            pixel = new_pixel;
+        });
+    }
+
+    // A permutation along with every permutation it was split into, in order
+    struct PermutationChain {
+        std::size_t pitch_range;
+        std::size_t permutation;
+        std::vector<std::size_t> pieces;
+        bool pieces_shared = false;
+        std::vector<std::vector<std::byte>> slices;
+    };
+
+    // Get about how big a 16-bit PCM or Ogg Vorbis permutation is once decoded to 16-bit PCM
+    static std::size_t decoded_pcm_size(const Invader::Parser::SoundPermutation &permutation) noexcept {
+        if(permutation.format == Invader::HEK::SoundFormat::SOUND_FORMAT_OGG_VORBIS) {
+            // Ogg Vorbis stores the decoded size in the buffer size, but don't trust it too far
+            return std::min<std::size_t>(permutation.buffer_size, permutation.samples.size() * 64);
+        }
+        return permutation.samples.size();
+    }
+
+    // Decode and encode every piece of a permutation a chunk at a time, filling each split permutation as it goes
+    static std::vector<std::vector<std::byte>> encode_permutation_chain(Invader::Parser::SoundPitchRange &pitch_range, const PermutationChain &chain, std::size_t channel_count, std::size_t max_permutation_bytes, const SoundOptions &options) {
+        auto format = pitch_range.permutations[chain.pieces[0]].format;
+
+        // Reuse the result of encoding the same samples the same way if we already have it
+        bool encoding = format == Invader::HEK::SoundFormat::SOUND_FORMAT_16_BIT_PCM || format == Invader::HEK::SoundFormat::SOUND_FORMAT_OGG_VORBIS;
+        bool reuse = encoding && options.reuse_results;
+        MemoKey key;
+        if(reuse) {
+            for(auto piece : chain.pieces) {
+                auto &samples = pitch_range.permutations[piece].samples;
+                key.add(samples.data(), samples.size());
+                key.add_value(samples.size());
+            }
+            key.add_value(format);
+            key.add_value(channel_count);
+            key.add_value(max_permutation_bytes);
+            key.add_value(options.fast_adpcm);
+
+            if(auto encoded = sound_memo().find(key)) {
+                std::size_t encoded_size = 0;
+                std::vector<std::vector<std::byte>> slices;
+                for(auto &slice : *encoded) {
+                    slices.emplace_back(copy_memoized_data(slice));
+                    encoded_size += slice.size();
+                }
+                StageTimer timer(Stage::STAGE_REUSE, encoded_size, 0, encoded_size / (XBOX_ADPCM_BLOCK_SIZE * channel_count) * XBOX_ADPCM_FRAMES_PER_BLOCK);
+                if(!chain.pieces_shared) {
+                    for(auto piece : chain.pieces) {
+                        BufferPool::shared().release(std::move(pitch_range.permutations[piece].samples));
+                    }
+                }
+                return slices;
+            }
+        }
+
+        // Work out how big the output will be so it only has to be allocated once
+        std::size_t bytes_per_frame = channel_count * sizeof(std::int16_t);
+        std::size_t expected_size = 0;
+        for(auto piece : chain.pieces) {
+            auto &permutation = pitch_range.permutations[piece];
+            if(encoding) {
+                expected_size += xbox_adpcm_size(decoded_pcm_size(permutation) / bytes_per_frame, channel_count);
+            }
+            else {
+                expected_size += permutation.samples.size();
+            }
+        }
+        LastResort::SplitSampleWriter writer(max_permutation_bytes, expected_size);
+
+        for(auto piece : chain.pieces) {
+            auto &permutation = pitch_range.permutations[piece];
+
+            switch(format) {
+                case Invader::HEK::SoundFormat::SOUND_FORMAT_16_BIT_PCM:
+                case Invader::HEK::SoundFormat::SOUND_FORMAT_OGG_VORBIS:
+                    if(options.fast_adpcm) {
+                        // Each block's last nibble needs the frame after it, so the stream holds back the end of each
+                        // chunk until the next one comes; the output is the same as encoding the whole piece at once
+                        XboxAdpcmStream stream(channel_count, format == Invader::HEK::SoundFormat::SOUND_FORMAT_16_BIT_PCM);
+                        auto samples = BufferPool::shared().acquire(xbox_adpcm_size(LastResort::PCM_FRAMES_PER_CHUNK + XBOX_ADPCM_FRAMES_PER_BLOCK, channel_count));
+                        auto encode_chunk = [&stream, &samples, &writer, &bytes_per_frame](const std::byte *pcm, std::size_t frame_count) {
+                            StageTimer timer(Stage::STAGE_ADPCM_ENCODE, frame_count * bytes_per_frame, 0, frame_count);
+                            stream.encode(pcm, frame_count, samples);
+                            timer.finish();
+                            writer.write(samples.data(), samples.size());
+                            samples.clear();
+                        };
+
+                        // Our encoder can take the big endian samples directly, so 16-bit PCM doesn't need to be converted first
+                        if(format == Invader::HEK::SoundFormat::SOUND_FORMAT_16_BIT_PCM) {
+                            std::size_t frame_count = permutation.samples.size() / bytes_per_frame;
+                            for(std::size_t f = 0; f < frame_count; f += LastResort::PCM_FRAMES_PER_CHUNK) {
+                                encode_chunk(permutation.samples.data() + f * bytes_per_frame, std::min(LastResort::PCM_FRAMES_PER_CHUNK, frame_count - f));
+                            }
+                        }
+                        else {
+                            LastResort::decode_pcm_chunks(format, permutation.samples.data(), permutation.samples.size(), channel_count, LastResort::PCM_FRAMES_PER_CHUNK, [&encode_chunk, &bytes_per_frame](const std::vector<std::byte> &pcm) {
+                                encode_chunk(pcm.data(), pcm.size() / bytes_per_frame);
+                            });
+                        }
+
+                        stream.finish(samples);
+                        writer.write(samples.data(), samples.size());
+                        BufferPool::shared().release(std::move(samples));
+                    }
+                    else {
+                        // Invader's encoder carries its state from one block to the next and can't pick up where it left
+                        // off, so give it the whole piece at once like we always have; starting it over on each chunk
+                        // would change the output. This means memory use still grows with the length of the piece here;
+                        // only --fast-adpcm encodes a chunk at a time.
+                        auto pcm = BufferPool::shared().acquire(decoded_pcm_size(permutation));
+                        LastResort::decode_pcm_chunks(format, permutation.samples.data(), permutation.samples.size(), channel_count, LastResort::PCM_FRAMES_PER_CHUNK, [&pcm](const std::vector<std::byte> &chunk) {
+                            pcm.insert(pcm.end(), chunk.begin(), chunk.end());
+                        });
+
+                        std::size_t frame_count = pcm.size() / bytes_per_frame;
+                        StageTimer timer(Stage::STAGE_ADPCM_ENCODE, pcm.size(), 0, frame_count);
+                        auto samples = Invader::SoundEncoder::encode_to_xbox_adpcm(pcm, 16, channel_count);
+                        timer.finish();
+                        BufferPool::shared().release(std::move(pcm));
+                        writer.write(std::move(samples));
+                    }
+
+                    // The source samples are no longer needed unless another permutation uses them too
+                    if(!chain.pieces_shared) {
+                        BufferPool::shared().release(std::move(permutation.samples));
+                    }
+                    break;
+                case Invader::HEK::SoundFormat::SOUND_FORMAT_XBOX_ADPCM:
+                    // Nothing to encode, so take the samples as-is unless another permutation needs them too
+                    if(chain.pieces_shared) {
+                        writer.write(permutation.samples.data(), permutation.samples.size());
+                    }
+                    else {
+                        writer.write(std::move(permutation.samples));
+                    }
+                    break;
+                default:
+                    throw UnsupportedFormatError("Unknown format");
+            }
+        }
+
+        auto &slices = writer.get_slices();
+        if(reuse) {
+            std::size_t encoded_size = 0;
+            for(auto &slice : slices) {
+                encoded_size += slice.size();
+            }
+            sound_memo().store(key, encoded_size, [&slices]() {
+                return std::vector<std::vector<std::byte>>(slices);
+            });
+        }
+        return std::move(slices);
+    }
+
+    bool sound_to_xbox_adpcm(Invader::Parser::Sound *sound, const SoundOptions &options) {
+        if(sound == nullptr) {
+            throw WrongTagClassError("Invalid tag provided for this action");
+        }
+
+        std::size_t converted = 0;
+        sound->format = Invader::HEK::SoundFormat::SOUND_FORMAT_XBOX_ADPCM;
+        std::size_t channel_count = sound->channel_count == Invader::HEK::SoundChannelCount::SOUND_CHANNEL_COUNT_MONO ? 1 : 2;
+        bool split = sound->flags & Invader::HEK::SoundFlagsFlag::SOUND_FLAGS_FLAG_SPLIT_LONG_SOUND_INTO_PERMUTATIONS;
+        static const constexpr std::size_t max_permutation_bytes = 65520; // precomputed
+
+        // First pass: find each real permutation and everything it was split into
+        std::vector<PermutationChain> chains;
+        for(std::size_t p = 0; p < sound->pitch_ranges.size(); p++) {
+            auto &i = sound->pitch_ranges[p];
+            std::size_t real_permutation_count;
+
+            if(split) {
+                if(i.actual_permutation_count > i.permutations.size()) {
+                    throw InvalidTagError(std::string("Actual permutation count for ") + i.name.string + " is wrong");
+                }
+                real_permutation_count = i.actual_permutation_count;
+            }
+
+            // If we don't have them split into permutations, just go throguh all of them
+            else {
+                real_permutation_count = i.permutations.size();
+            }
+
+            std::vector<std::size_t> piece_uses(i.permutations.size());
+            auto first_chain = chains.size();
+
+            for(std::size_t j = 0; j < real_permutation_count; j++) {
+                auto &chain = chains.emplace_back();
+                chain.pitch_range = p;
+                chain.permutation = j;
+
+                std::size_t next_permutation = j;
+                do {
+                    if(split && (next_permutation >= i.permutations.size() || chain.pieces.size() >= i.permutations.size())) {
+                        throw InvalidTagError("Next permutation is out of bounds");
+                    }
+
+                    chain.pieces.emplace_back(next_permutation);
+                    piece_uses[next_permutation]++;
+                    next_permutation = i.permutations[next_permutation].next_permutation_index;
+                } while(split && next_permutation != NULL_INDEX);
+
+                if(i.permutations[j].format != Invader::HEK::SoundFormat::SOUND_FORMAT_XBOX_ADPCM) {
+                    converted++;
+                }
+            }
+
+            for(auto c = first_chain; c < chains.size(); c++) {
+                for(auto piece : chains[c].pieces) {
+                    chains[c].pieces_shared = chains[c].pieces_shared || piece_uses[piece] > 1;
+                }
+            }
+        }
+
+        // Every chain is independent, so encode them all at once
+        LastResort::parallel_for(chains.size(), [&sound, &chains, &channel_count, &split, &options](std::size_t c) {
+            auto &chain = chains[c];
+            chain.slices = encode_permutation_chain(sound->pitch_ranges[chain.pitch_range], chain, channel_count, split ? max_permutation_bytes : std::numeric_limits<std::size_t>::max(), options);
+        });
+
+        // Then put them back in order
+        auto next_chain = chains.begin();
+        for(std::size_t p = 0; p < sound->pitch_ranges.size(); p++) {
+            auto &i = sound->pitch_ranges[p];
+            std::vector<Invader::Parser::SoundPermutation> permutations_memes;
+            auto first_chain = next_chain;
+
+            for(; next_chain != chains.end() && next_chain->pitch_range == p; next_chain++) {
+                auto &new_permutation = permutations_memes.emplace_back(std::move(i.permutations[next_chain->permutation]));
+                new_permutation.samples.clear();
+                new_permutation.buffer_size = 0;
+                new_permutation.format = Invader::HEK::SoundFormat::SOUND_FORMAT_XBOX_ADPCM;
+            }
+
+            i.permutations.clear();
+
+            // Copy in new permutations
+            i.permutations = std::move(permutations_memes);
+
+            // Now link up the split permutations, adding every slice after the first one to the end
+            std::size_t j = 0;
+            for(auto chain = first_chain; chain != next_chain; chain++, j++) {
+                auto &slices = chain->slices;
+                auto *permutation_to_modify = &i.permutations[j];
+                std::optional<Invader::Parser::SoundPermutation> template_sound;
+                if(slices.size() > 1) {
+                    template_sound = *permutation_to_modify;
+                }
+
+                for(std::size_t q = 0; q < slices.size(); q++) {
+                    if(q) {
+                        permutation_to_modify->next_permutation_index = i.permutations.size();
+                        permutation_to_modify = &i.permutations.emplace_back(*template_sound);
+                    }
+                    permutation_to_modify->samples = std::move(slices[q]);
+                    if(split) {
+                        permutation_to_modify->next_permutation_index = NULL_INDEX;
+                    }
+                }
+            }
+        }
+
+        if(converted > 0) {
+            report(DiagnosticLevel::DIAGNOSTIC_LEVEL_SUCCESS, "Converted %zu permutation%s into Xbox ADPCM", converted, converted == 1 ? "" : "s");
+            return true;
+        }
+        else {
+            return false;
+        }
+    }
+}
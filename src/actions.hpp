@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__ACTIONS_HPP
+#define LAST_RESORT__ACTIONS_HPP
+
+#include <optional>
+#include <variant>
+#include <invader/tag/hek/definition.hpp>
+
+namespace Invader::Parser {
+    class Bitmap;
+    class Sound;
+}
+
+namespace LastResort {
+    enum LastResortAction {
+        LAST_RESORT_ACTION_HUD_METER_SWAP,
+        LAST_RESORT_ACTION_MULTIPURPOSE_GBX_TO_XBOX,
+        LAST_RESORT_ACTION_MULTIPURPOSE_XBOX_TO_GBX,
+        LAST_RESORT_ACTION_BITMAP_PASSTHROUGH,
+        LAST_RESORT_ACTION_SOUND_TO_XBOX_ADPCM
+    };
+
+    using PreferredFormat = std::variant<Invader::HEK::BitmapDataFormat, Invader::HEK::BitmapFormat>;
+
+    struct BitmapOptions {
+        std::optional<PreferredFormat> force_format;
+        bool dither = false;
+        bool generate_mipmaps = false;
+        bool gamma_correct_mipmaps = false;
+        bool reuse_results = false; // remember converted bitmap data so identical bitmap data can be reused (see clear_conversion_memo())
+    };
+
+    struct SoundOptions {
+        bool fast_adpcm = false; // use our own SIMD encoder rather than Invader's (faster, but the output differs)
+        bool reuse_results = false; // remember encoded permutations so identical permutations can be reused (see clear_conversion_memo())
+    };
+
+    /**
+     * Move the meter into the color channels and the mask into the alpha channel of every bitmap
+     * @param bitmap  bitmap tag (if null, WrongTagClassError is thrown)
+     * @param options bitmap options
+     */
+    void hud_meter_swap(Invader::Parser::Bitmap *bitmap, const BitmapOptions &options);
+
+    /**
+     * Convert every bitmap from the Gearbox multipurpose channel order to the Xbox one
+     * @param bitmap  bitmap tag (if null, WrongTagClassError is thrown)
+     * @param options bitmap options
+     */
+    void multi_gbx_to_xbox(Invader::Parser::Bitmap *bitmap, const BitmapOptions &options);
+
+    /**
+     * Convert every bitmap from the Xbox multipurpose channel order to the Gearbox one
+     * @param bitmap  bitmap tag (if null, WrongTagClassError is thrown)
+     * @param options bitmap options
+     */
+    void multi_xbox_to_gbx(Invader::Parser::Bitmap *bitmap, const BitmapOptions &options);
+
+    /**
+     * Re-encode every bitmap without changing any channels
+     * @param bitmap  bitmap tag (if null, WrongTagClassError is thrown)
+     * @param options bitmap options
+     */
+    void bitmap_passthrough(Invader::Parser::Bitmap *bitmap, const BitmapOptions &options);
+
+    /**
+     * Convert every permutation of a sound to Xbox ADPCM
+     * @param sound   sound tag (if null, WrongTagClassError is thrown)
+     * @param options sound options
+     * @return        true if anything was converted, false if the sound was already Xbox ADPCM
+     */
+    bool sound_to_xbox_adpcm(Invader::Parser::Sound *sound, const SoundOptions &options);
+
+    /**
+     * Forget every converted bitmap data and sound permutation kept for reuse. With reuse_results set, the actions
+     * remember what they convert for the rest of the process (up to a memory limit) so identical data in other tags
+     * doesn't have to be converted again; this never changes the output.
+     */
+    void clear_conversion_memo() noexcept;
+}
+
+#endif
@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include "buffer_pool.hpp"
+
+namespace LastResort {
+    std::vector<std::byte> BufferPool::acquire(std::size_t capacity) {
+        {
+            std::scoped_lock lock(this->mutex);
+
+            // Take the smallest buffer that fits so big buffers stay available for big bitmaps
+            auto best = this->buffers.end();
+            for(auto i = this->buffers.begin(); i != this->buffers.end(); i++) {
+                if(i->capacity() >= capacity && (best == this->buffers.end() || i->capacity() < best->capacity())) {
+                    best = i;
+                }
+            }
+
+            if(best != this->buffers.end()) {
+                auto buffer = std::move(*best);
+                this->buffers.erase(best);
+                this->bytes -= buffer.capacity();
+                return buffer;
+            }
+        }
+
+        std::vector<std::byte> buffer;
+        buffer.reserve(capacity);
+        return buffer;
+    }
+
+    void BufferPool::release(std::vector<std::byte> &&buffer) noexcept {
+        auto capacity = buffer.capacity();
+        if(capacity == 0 || capacity > this->max_bytes) {
+            std::vector<std::byte>().swap(buffer);
+            return;
+        }
+        buffer.clear();
+
+        {
+            std::scoped_lock lock(this->mutex);
+
+            // Make room by dropping the smallest buffers, which are the cheapest to allocate again
+            while(!this->buffers.empty() && (this->bytes + capacity > this->max_bytes || this->buffers.size() >= this->max_buffers)) {
+                auto smallest = std::min_element(this->buffers.begin(), this->buffers.end(), [](auto &a, auto &b) { return a.capacity() < b.capacity(); });
+                if(smallest->capacity() > capacity) {
+                    break;
+                }
+                this->bytes -= smallest->capacity();
+                this->buffers.erase(smallest);
+            }
+
+            if(this->bytes + capacity <= this->max_bytes && this->buffers.size() < this->max_buffers) {
+                this->bytes += capacity;
+                this->buffers.emplace_back(std::move(buffer));
+                return;
+            }
+        }
+
+        // Didn't fit, so just free it
+        std::vector<std::byte>().swap(buffer);
+    }
+
+    void BufferPool::clear() noexcept {
+        std::vector<std::vector<std::byte>> freed;
+        std::scoped_lock lock(this->mutex);
+        freed.swap(this->buffers);
+        this->bytes = 0;
+    }
+
+    BufferPool &BufferPool::shared() noexcept {
+        static BufferPool pool(64 * 1024 * 1024, 64);
+        return pool;
+    }
+}
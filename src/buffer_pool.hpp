@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__BUFFER_POOL_HPP
+#define LAST_RESORT__BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace LastResort {
+    /**
+     * Keeps buffers that are no longer needed so later conversions can reuse their memory instead of allocating more.
+     * This can be used from several threads at once.
+     */
+    class BufferPool {
+    public:
+        /**
+         * Get an empty buffer that can hold at least the given number of bytes without reallocating
+         * @param capacity number of bytes
+         * @return         buffer
+         */
+        std::vector<std::byte> acquire(std::size_t capacity);
+
+        /**
+         * Give a buffer to the pool. If the pool is full, the smallest buffers are freed first.
+         * @param buffer buffer to give
+         */
+        void release(std::vector<std::byte> &&buffer) noexcept;
+
+        /**
+         * Free every buffer in the pool
+         */
+        void clear() noexcept;
+
+        /**
+         * Get the pool shared by every conversion in the process
+         * @return pool
+         */
+        static BufferPool &shared() noexcept;
+
+        /**
+         * Instantiate a pool
+         * @param max_bytes    maximum total capacity of the buffers kept
+         * @param max_buffers  maximum number of buffers kept
+         */
+        BufferPool(std::size_t max_bytes, std::size_t max_buffers) noexcept : max_bytes(max_bytes), max_buffers(max_buffers) {}
+
+        BufferPool(const BufferPool &) = delete;
+        BufferPool &operator=(const BufferPool &) = delete;
+
+    private:
+        std::mutex mutex;
+        std::vector<std::vector<std::byte>> buffers;
+        std::size_t bytes = 0;
+        std::size_t max_bytes;
+        std::size_t max_buffers;
+    };
+}
+
+#endif
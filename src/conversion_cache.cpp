@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <invader/file/file.hpp>
+#include "conversion_cache.hpp"
+#include "file_io.hpp"
+#include "hash.hpp"
+
+namespace LastResort {
+    ConversionCacheKey ConversionCacheKey::make(const std::byte *input, std::size_t size, const std::string &settings) noexcept {
+        ConversionCacheKey key;
+        static constexpr const std::uint64_t seeds[] = { 0, 0x4C617374526573ULL };
+        for(std::size_t i = 0; i < sizeof(key.hash) / sizeof(*key.hash); i++) {
+            key.hash[i] = hash_bytes(settings.data(), settings.size(), hash_bytes(input, size, seeds[i]));
+        }
+        return key;
+    }
+
+    std::string ConversionCacheKey::to_string() const {
+        char hex[33];
+        std::snprintf(hex, sizeof(hex), "%016" PRIx64 "%016" PRIx64, this->hash[0], this->hash[1]);
+        return hex;
+    }
+
+    ConversionCache::ConversionCache(const std::filesystem::path &directory, std::uintmax_t max_size) : directory(directory), max_size(max_size) {
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+    }
+
+    std::filesystem::path ConversionCache::entry_path(const ConversionCacheKey &key) const {
+        auto name = key.to_string();
+        return this->directory / name.substr(0, 2) / (name + ".tag");
+    }
+
+    std::optional<std::vector<std::byte>> ConversionCache::load(const ConversionCacheKey &key) {
+        auto path = this->entry_path(key);
+        auto data = Invader::File::open_file(path);
+        if(!data.has_value()) {
+            this->misses++;
+            return std::nullopt;
+        }
+
+        // Mark it as recently used
+        std::error_code ec;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+
+        this->hits++;
+        return data;
+    }
+
+    void ConversionCache::store(const ConversionCacheKey &key, const std::vector<std::byte> &data) {
+        auto path = this->entry_path(key);
+        std::error_code ec;
+        std::filesystem::create_directories(path.parent_path(), ec);
+
+        // Written atomically so other processes never see a partial entry
+        write_file_atomically(path, data.data(), data.size());
+    }
+
+    void ConversionCache::evict() {
+        if(this->max_size == 0) {
+            return;
+        }
+
+        struct Entry {
+            std::filesystem::path path;
+            std::uintmax_t size;
+            std::filesystem::file_time_type last_used;
+        };
+
+        std::vector<Entry> entries;
+        std::uintmax_t total_size = 0;
+        std::error_code ec;
+        for(auto i = std::filesystem::recursive_directory_iterator(this->directory, ec); !ec && i != std::filesystem::recursive_directory_iterator(); i.increment(ec)) {
+            if(!i->is_regular_file() || i->path().extension() != ".tag") {
+                continue;
+            }
+
+            std::error_code entry_ec;
+            auto &entry = entries.emplace_back();
+            entry.path = i->path();
+            entry.size = i->file_size(entry_ec);
+            entry.last_used = i->last_write_time(entry_ec);
+            if(entry_ec) {
+                entries.pop_back();
+                continue;
+            }
+            total_size += entry.size;
+        }
+
+        if(total_size <= this->max_size) {
+            return;
+        }
+
+        std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.last_used < b.last_used; });
+        for(auto &entry : entries) {
+            if(total_size <= this->max_size) {
+                break;
+            }
+            if(std::filesystem::remove(entry.path, ec)) {
+                total_size -= entry.size;
+            }
+        }
+    }
+}
@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__CONVERSION_CACHE_HPP
+#define LAST_RESORT__CONVERSION_CACHE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace LastResort {
+    /**
+     * Key for a cached conversion: a hash of the input tag plus every setting that affects the output
+     */
+    struct ConversionCacheKey {
+        std::uint64_t hash[2];
+
+        /**
+         * Make a key
+         * @param input    input tag data
+         * @param size     size of the input tag data
+         * @param settings description of the conversion settings (action, format, tool versions, etc.)
+         * @return         key
+         */
+        static ConversionCacheKey make(const std::byte *input, std::size_t size, const std::string &settings) noexcept;
+
+        /**
+         * Get the key as a hexadecimal string
+         * @return string
+         */
+        std::string to_string() const;
+    };
+
+    /**
+     * On-disk cache of converted tags, keyed by their input, evicted least recently used first
+     */
+    class ConversionCache {
+    public:
+        /**
+         * Look up a conversion, marking it as recently used
+         * @param key key to look up
+         * @return    output tag data, or empty data if the tag did not need converting, or std::nullopt on a miss
+         */
+        std::optional<std::vector<std::byte>> load(const ConversionCacheKey &key);
+
+        /**
+         * Store a conversion. Failing to write to the cache is not fatal and is silently ignored.
+         * @param key  key to store
+         * @param data output tag data, or empty data if the tag did not need converting
+         */
+        void store(const ConversionCacheKey &key, const std::vector<std::byte> &data);
+
+        /**
+         * Delete the least recently used entries until the cache fits within its maximum size
+         */
+        void evict();
+
+        /**
+         * Get the number of lookups that were found
+         * @return hits
+         */
+        std::size_t get_hits() const noexcept {
+            return this->hits;
+        }
+
+        /**
+         * Get the number of lookups that were not found
+         * @return misses
+         */
+        std::size_t get_misses() const noexcept {
+            return this->misses;
+        }
+
+        /**
+         * Instantiate a cache
+         * @param directory directory to store entries in; created if needed
+         * @param max_size  maximum size of the cache in bytes (0 = unlimited)
+         */
+        ConversionCache(const std::filesystem::path &directory, std::uintmax_t max_size);
+
+    private:
+        std::filesystem::path directory;
+        std::uintmax_t max_size;
+        std::atomic<std::size_t> hits = 0;
+        std::atomic<std::size_t> misses = 0;
+
+        std::filesystem::path entry_path(const ConversionCacheKey &key) const;
+    };
+}
+
+#endif
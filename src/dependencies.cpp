@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cstring>
+#include <invader/file/file.hpp>
+#include <invader/tag/parser/parser_struct.hpp>
+
+#include "dependencies.hpp"
+
+namespace LastResort {
+    using TagFourCC = Invader::HEK::TagFourCC;
+
+    // Decide what a bitmap or sound is for from the field referencing it
+    static std::optional<ReferenceRole> reference_role(TagFourCC tag_fourcc, const char *member_name) noexcept {
+        if(tag_fourcc == TagFourCC::TAG_FOURCC_SOUND) {
+            return ReferenceRole::REFERENCE_ROLE_SOUND;
+        }
+        if(tag_fourcc != TagFourCC::TAG_FOURCC_BITMAP || member_name == nullptr) {
+            return std::nullopt;
+        }
+        if(std::strcmp(member_name, "meter_bitmap") == 0) {
+            return ReferenceRole::REFERENCE_ROLE_HUD_METER;
+        }
+        if(std::strcmp(member_name, "multipurpose_map") == 0) {
+            return ReferenceRole::REFERENCE_ROLE_MULTIPURPOSE_MAP;
+        }
+        return std::nullopt;
+    }
+
+    static void find_references_in_struct(Invader::Parser::ParserStruct &tag_struct, std::vector<TagReference> &references) {
+        for(auto &value : tag_struct.get_values()) {
+            switch(value.get_type()) {
+                case Invader::Parser::ParserStructValue::ValueType::VALUE_TYPE_DEPENDENCY: {
+                    auto &dependency = value.get_dependency();
+                    if(dependency.path.empty() || dependency.tag_fourcc == TagFourCC::TAG_FOURCC_NULL || dependency.tag_fourcc == TagFourCC::TAG_FOURCC_NONE) {
+                        break;
+                    }
+                    auto &reference = references.emplace_back();
+                    reference.path = Invader::File::halo_path_to_preferred_path(dependency.path) + "." + Invader::HEK::tag_fourcc_to_extension(dependency.tag_fourcc);
+                    reference.tag_fourcc = dependency.tag_fourcc;
+                    reference.role = reference_role(dependency.tag_fourcc, value.get_member_name());
+                    break;
+                }
+                case Invader::Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE: {
+                    auto count = value.get_array_size();
+                    for(std::size_t i = 0; i < count; i++) {
+                        find_references_in_struct(value.get_object_in_array(i), references);
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+
+    std::vector<TagReference> find_tag_references(Invader::Parser::ParserStruct &tag) {
+        std::vector<TagReference> references;
+        find_references_in_struct(tag, references);
+        return references;
+    }
+
+    const char *reference_role_name(ReferenceRole role) noexcept {
+        switch(role) {
+            case ReferenceRole::REFERENCE_ROLE_HUD_METER:
+                return "HUD meter";
+            case ReferenceRole::REFERENCE_ROLE_MULTIPURPOSE_MAP:
+                return "multipurpose map";
+            case ReferenceRole::REFERENCE_ROLE_SOUND:
+                return "sound";
+        }
+        return "unknown";
+    }
+}
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__DEPENDENCIES_HPP
+#define LAST_RESORT__DEPENDENCIES_HPP
+
+#include <optional>
+#include <string>
+#include <vector>
+#include <invader/tag/hek/definition.hpp>
+
+namespace Invader::Parser {
+    class ParserStruct;
+}
+
+namespace LastResort {
+    /**
+     * What a referenced tag is used for, as far as converting it goes
+     */
+    enum ReferenceRole {
+        REFERENCE_ROLE_HUD_METER,
+        REFERENCE_ROLE_MULTIPURPOSE_MAP,
+        REFERENCE_ROLE_SOUND
+    };
+
+    struct TagReference {
+        std::string path; // preferred path, with the extension
+        Invader::HEK::TagFourCC tag_fourcc;
+        std::optional<ReferenceRole> role;
+    };
+
+    /**
+     * Find every tag referenced by a tag, including from every block inside of it. Null references are skipped.
+     *
+     * Bitmaps referenced as a HUD meter (a "meter bitmap" in a unit or weapon HUD interface) or as a shader's
+     * multipurpose map get that role, and every sound gets REFERENCE_ROLE_SOUND.
+     *
+     * @param tag parsed tag
+     * @return    references, in the order they appear in the tag
+     */
+    std::vector<TagReference> find_tag_references(Invader::Parser::ParserStruct &tag);
+
+    /**
+     * Get the name of a reference role
+     * @param role role
+     * @return     name
+     */
+    const char *reference_role_name(ReferenceRole role) noexcept;
+}
+
+#endif
@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cstdarg>
+#include <cstdio>
+#include <invader/printf.hpp>
+
+#include "diagnostics.hpp"
+
+namespace LastResort {
+    void DiagnosticSink::add(DiagnosticLevel level, std::string message) {
+        std::scoped_lock lock(this->mutex);
+        this->diagnostics.push_back(Diagnostic { level, std::move(message) });
+    }
+
+    std::vector<Diagnostic> DiagnosticSink::take() {
+        std::scoped_lock lock(this->mutex);
+        return std::move(this->diagnostics);
+    }
+
+    void report(DiagnosticLevel level, const char *format, ...) {
+        std::va_list args;
+        va_start(args, format);
+        std::va_list args_copy;
+        va_copy(args_copy, args);
+        int length = std::vsnprintf(nullptr, 0, format, args_copy);
+        va_end(args_copy);
+
+        std::string message;
+        if(length > 0) {
+            message.resize(static_cast<std::size_t>(length) + 1);
+            std::vsnprintf(message.data(), message.size(), format, args);
+            message.resize(static_cast<std::size_t>(length));
+        }
+        va_end(args);
+
+        if(auto *sink = Detail::current_diagnostics) {
+            sink->add(level, std::move(message));
+        }
+        else {
+            print_diagnostic(Diagnostic { level, std::move(message) });
+        }
+    }
+
+    void print_diagnostic(const Diagnostic &diagnostic) {
+        switch(diagnostic.level) {
+            case DiagnosticLevel::DIAGNOSTIC_LEVEL_INFO:
+                oprintf("%s\n", diagnostic.message.c_str());
+                break;
+            case DiagnosticLevel::DIAGNOSTIC_LEVEL_SUCCESS:
+                oprintf_success("%s", diagnostic.message.c_str());
+                break;
+            case DiagnosticLevel::DIAGNOSTIC_LEVEL_WARNING:
+                eprintf_warn("%s", diagnostic.message.c_str());
+                break;
+        }
+    }
+}
@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__DIAGNOSTICS_HPP
+#define LAST_RESORT__DIAGNOSTICS_HPP
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace LastResort {
+    enum DiagnosticLevel {
+        DIAGNOSTIC_LEVEL_INFO,
+        DIAGNOSTIC_LEVEL_SUCCESS,
+        DIAGNOSTIC_LEVEL_WARNING
+    };
+
+    struct Diagnostic {
+        DiagnosticLevel level;
+        std::string message;
+    };
+
+    /**
+     * Collects diagnostics from any number of threads
+     */
+    class DiagnosticSink {
+    public:
+        /**
+         * Add a diagnostic
+         * @param level   level
+         * @param message message, without a trailing newline
+         */
+        void add(DiagnosticLevel level, std::string message);
+
+        /**
+         * Take every diagnostic collected so far, in the order they were added
+         * @return diagnostics
+         */
+        std::vector<Diagnostic> take();
+
+    private:
+        std::mutex mutex;
+        std::vector<Diagnostic> diagnostics;
+    };
+
+    namespace Detail {
+        inline thread_local DiagnosticSink *current_diagnostics = nullptr;
+    }
+
+    /**
+     * Send diagnostics reported on this thread (and by parallel_for() jobs it starts) to a sink until this goes out of scope
+     */
+    class DiagnosticScope {
+    public:
+        /**
+         * Start collecting diagnostics
+         * @param sink sink to add to, or null to print them instead
+         */
+        explicit DiagnosticScope(DiagnosticSink *sink) noexcept : previous(Detail::current_diagnostics) {
+            Detail::current_diagnostics = sink;
+        }
+
+        ~DiagnosticScope() {
+            Detail::current_diagnostics = this->previous;
+        }
+
+        DiagnosticScope(const DiagnosticScope &) = delete;
+        DiagnosticScope &operator=(const DiagnosticScope &) = delete;
+
+    private:
+        DiagnosticSink *previous;
+    };
+
+    /**
+     * Report a diagnostic to the current sink, or print it if there is none
+     * @param level  level
+     * @param format printf-style format, without a trailing newline
+     */
+    void report(DiagnosticLevel level, const char *format, ...)
+#ifdef __GNUC__
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+    /**
+     * Print a diagnostic the same way report() does when there is no sink
+     * @param diagnostic diagnostic to print
+     */
+    void print_diagnostic(const Diagnostic &diagnostic);
+}
+
+#endif
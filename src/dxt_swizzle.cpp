@@ -0,0 +1,402 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "dxt_swizzle.hpp"
+#include "parallel.hpp"
+
+namespace LastResort {
+    using BitmapDataFormat = Invader::HEK::BitmapDataFormat;
+
+    enum Channel {
+        CHANNEL_RED,
+        CHANNEL_GREEN,
+        CHANNEL_BLUE,
+        CHANNEL_ALPHA
+    };
+
+    // Byte offset of each channel in Invader::Pixel, which is how PixelShuffle addresses them
+    static const std::size_t channel_offsets[] = {
+        offsetof(Invader::Pixel, red),
+        offsetof(Invader::Pixel, green),
+        offsetof(Invader::Pixel, blue),
+        offsetof(Invader::Pixel, alpha)
+    };
+
+    struct Texel {
+        std::uint8_t channels[4];
+    };
+
+    struct ColorEndpoint {
+        std::uint8_t channels[3]; // 5-6-5 bit values, not expanded
+    };
+
+    static const std::size_t color_bits[] = { 5, 6, 5 };
+
+    static std::uint8_t expand(std::uint8_t value, std::size_t bits) noexcept {
+        return bits == 5 ? static_cast<std::uint8_t>((value << 3) | (value >> 2)) : static_cast<std::uint8_t>((value << 2) | (value >> 4));
+    }
+
+    // Find the n-bit value that expands to exactly this 8-bit value, if any
+    static bool contract(std::uint8_t value, std::size_t bits, std::uint8_t &contracted) noexcept {
+        contracted = static_cast<std::uint8_t>(value >> (8 - bits));
+        return expand(contracted, bits) == value;
+    }
+
+    static ColorEndpoint unpack_565(std::uint16_t color) noexcept {
+        return {{ static_cast<std::uint8_t>((color >> 11) & 0x1F), static_cast<std::uint8_t>((color >> 5) & 0x3F), static_cast<std::uint8_t>(color & 0x1F) }};
+    }
+
+    static std::uint16_t pack_565(const ColorEndpoint &color) noexcept {
+        return static_cast<std::uint16_t>((color.channels[CHANNEL_RED] << 11) | (color.channels[CHANNEL_GREEN] << 5) | color.channels[CHANNEL_BLUE]);
+    }
+
+    static std::uint16_t read_16(const std::uint8_t *data) noexcept {
+        return static_cast<std::uint16_t>(data[0] | (data[1] << 8));
+    }
+
+    static void write_16(std::uint8_t *data, std::uint16_t value) noexcept {
+        data[0] = static_cast<std::uint8_t>(value);
+        data[1] = static_cast<std::uint8_t>(value >> 8);
+    }
+
+    static std::uint32_t read_32(const std::uint8_t *data) noexcept {
+        return static_cast<std::uint32_t>(read_16(data)) | (static_cast<std::uint32_t>(read_16(data + 2)) << 16);
+    }
+
+    static void write_32(std::uint8_t *data, std::uint32_t value) noexcept {
+        write_16(data, static_cast<std::uint16_t>(value));
+        write_16(data + 2, static_cast<std::uint16_t>(value >> 16));
+    }
+
+    static std::uint64_t read_48(const std::uint8_t *data) noexcept {
+        return static_cast<std::uint64_t>(read_16(data)) | (static_cast<std::uint64_t>(read_32(data + 2)) << 16);
+    }
+
+    static void write_48(std::uint8_t *data, std::uint64_t value) noexcept {
+        write_16(data, static_cast<std::uint16_t>(value));
+        write_32(data + 2, static_cast<std::uint32_t>(value >> 16));
+    }
+
+    // Decode an 8-byte color block the same way squish (and therefore Invader) does
+    static void decode_color_block(const std::uint8_t *block, bool dxt1, Texel *texels) noexcept {
+        auto a = read_16(block);
+        auto b = read_16(block + 2);
+        auto ea = unpack_565(a);
+        auto eb = unpack_565(b);
+        bool three_color = dxt1 && a <= b;
+
+        Texel codes[4];
+        for(std::size_t c = 0; c < 3; c++) {
+            int ca = expand(ea.channels[c], color_bits[c]);
+            int cb = expand(eb.channels[c], color_bits[c]);
+            codes[0].channels[c] = static_cast<std::uint8_t>(ca);
+            codes[1].channels[c] = static_cast<std::uint8_t>(cb);
+            if(three_color) {
+                codes[2].channels[c] = static_cast<std::uint8_t>((ca + cb) / 2);
+                codes[3].channels[c] = 0;
+            }
+            else {
+                codes[2].channels[c] = static_cast<std::uint8_t>((2 * ca + cb) / 3);
+                codes[3].channels[c] = static_cast<std::uint8_t>((ca + 2 * cb) / 3);
+            }
+        }
+        codes[0].channels[CHANNEL_ALPHA] = 0xFF;
+        codes[1].channels[CHANNEL_ALPHA] = 0xFF;
+        codes[2].channels[CHANNEL_ALPHA] = 0xFF;
+        codes[3].channels[CHANNEL_ALPHA] = three_color ? 0x00 : 0xFF;
+
+        auto indices = read_32(block + 4);
+        for(std::size_t i = 0; i < 16; i++) {
+            texels[i] = codes[(indices >> (i * 2)) & 3];
+        }
+    }
+
+    static void decode_dxt3_alpha_block(const std::uint8_t *block, Texel *texels) noexcept {
+        for(std::size_t i = 0; i < 16; i++) {
+            auto alpha = static_cast<std::uint8_t>((block[i / 2] >> ((i % 2) * 4)) & 0xF);
+            texels[i].channels[CHANNEL_ALPHA] = static_cast<std::uint8_t>(alpha | (alpha << 4));
+        }
+    }
+
+    static void dxt5_alpha_codes(std::uint8_t a0, std::uint8_t a1, std::uint8_t *codes) noexcept {
+        codes[0] = a0;
+        codes[1] = a1;
+        if(a0 <= a1) {
+            for(int i = 1; i < 5; i++) {
+                codes[1 + i] = static_cast<std::uint8_t>(((5 - i) * a0 + i * a1) / 5);
+            }
+            codes[6] = 0x00;
+            codes[7] = 0xFF;
+        }
+        else {
+            for(int i = 1; i < 7; i++) {
+                codes[1 + i] = static_cast<std::uint8_t>(((7 - i) * a0 + i * a1) / 7);
+            }
+        }
+    }
+
+    static void decode_dxt5_alpha_block(const std::uint8_t *block, Texel *texels) noexcept {
+        std::uint8_t codes[8];
+        dxt5_alpha_codes(block[0], block[1], codes);
+        auto indices = read_48(block + 2);
+        for(std::size_t i = 0; i < 16; i++) {
+            texels[i].channels[CHANNEL_ALPHA] = codes[(indices >> (i * 3)) & 7];
+        }
+    }
+
+    static void decode_block(const std::uint8_t *block, BitmapDataFormat format, Texel *texels) noexcept {
+        switch(format) {
+            case BitmapDataFormat::BITMAP_DATA_FORMAT_DXT1:
+                decode_color_block(block, true, texels);
+                break;
+            case BitmapDataFormat::BITMAP_DATA_FORMAT_DXT3:
+                decode_color_block(block + 8, false, texels);
+                decode_dxt3_alpha_block(block, texels);
+                break;
+            default:
+                decode_color_block(block + 8, false, texels);
+                decode_dxt5_alpha_block(block, texels);
+                break;
+        }
+    }
+
+    // Where each output channel comes from: an input channel, or a constant if channel is negative
+    struct ChannelSource {
+        int channel;
+        std::uint8_t constant;
+    };
+
+    // Build an alpha block holding the given values using only its endpoints (and 0/255 in 6-value mode), so the result
+    // does not depend on how a decoder rounds interpolated values
+    static bool encode_dxt5_alpha_block(const Texel *texels, std::uint8_t *block) noexcept {
+        std::uint8_t low = 0xFF, high = 0x00;
+        std::uint8_t low_inner = 0xFF, high_inner = 0x00;
+        for(std::size_t i = 0; i < 16; i++) {
+            auto alpha = texels[i].channels[CHANNEL_ALPHA];
+            low = std::min(low, alpha);
+            high = std::max(high, alpha);
+            if(alpha != 0x00 && alpha != 0xFF) {
+                low_inner = std::min(low_inner, alpha);
+                high_inner = std::max(high_inner, alpha);
+            }
+        }
+
+        // 8-value mode with the extremes as endpoints, or 6-value mode which also has 0 and 255
+        std::uint8_t a0, a1;
+        if(low == high) {
+            a0 = low;
+            a1 = low;
+        }
+        else if(low_inner > high_inner) {
+            a0 = 0x00; // only 0 and 255 are used
+            a1 = 0xFF;
+        }
+        else {
+            a0 = high;
+            a1 = low;
+        }
+
+        for(int attempt = 0; attempt < 2; attempt++) {
+            std::uint8_t codes[8];
+            dxt5_alpha_codes(a0, a1, codes);
+
+            std::uint64_t indices = 0;
+            bool fits = true;
+            for(std::size_t i = 0; i < 16 && fits; i++) {
+                auto alpha = texels[i].channels[CHANNEL_ALPHA];
+                std::uint64_t index;
+                if(alpha == codes[0]) {
+                    index = 0;
+                }
+                else if(alpha == codes[1]) {
+                    index = 1;
+                }
+                else if(a0 <= a1 && alpha == 0x00) {
+                    index = 6;
+                }
+                else if(a0 <= a1 && alpha == 0xFF) {
+                    index = 7;
+                }
+                else {
+                    fits = false;
+                    break;
+                }
+                indices |= index << (i * 3);
+            }
+
+            if(fits) {
+                block[0] = a0;
+                block[1] = a1;
+                write_48(block + 2, indices);
+                return true;
+            }
+
+            // Try 6-value mode with the values that aren't 0 or 255
+            if(low_inner > high_inner) {
+                break;
+            }
+            a0 = low_inner;
+            a1 = high_inner;
+        }
+
+        return false;
+    }
+
+    static bool encode_dxt3_alpha_block(const Texel *texels, std::uint8_t *block) noexcept {
+        std::memset(block, 0, 8);
+        for(std::size_t i = 0; i < 16; i++) {
+            auto alpha = texels[i].channels[CHANNEL_ALPHA];
+            if(alpha % 17 != 0) {
+                return false;
+            }
+            block[i / 2] |= static_cast<std::uint8_t>((alpha / 17) << ((i % 2) * 4));
+        }
+        return true;
+    }
+
+    // Rewrite a color block's endpoints for the shuffle, keeping its indices
+    static bool shuffle_color_block(const std::uint8_t *input, std::uint8_t *output, bool dxt1, const ChannelSource *sources, const Texel *expected) noexcept {
+        auto a = read_16(input);
+        auto b = read_16(input + 2);
+        ColorEndpoint endpoints[2] = { unpack_565(a), unpack_565(b) };
+        ColorEndpoint new_endpoints[2];
+
+        for(std::size_t c = 0; c < 3; c++) {
+            auto &source = sources[c];
+
+            // Straight from another color channel
+            if(source.channel >= CHANNEL_RED && source.channel <= CHANNEL_BLUE) {
+                for(std::size_t e = 0; e < 2; e++) {
+                    auto value = expand(endpoints[e].channels[source.channel], color_bits[source.channel]);
+                    if(!contract(value, color_bits[c], new_endpoints[e].channels[c])) {
+                        return false;
+                    }
+                }
+            }
+
+            // Constant (or from alpha, which then has to be constant across the block)
+            else {
+                auto value = source.channel == CHANNEL_ALPHA ? expected[0].channels[c] : source.constant;
+                if(!contract(value, color_bits[c], new_endpoints[0].channels[c])) {
+                    return false;
+                }
+                new_endpoints[1].channels[c] = new_endpoints[0].channels[c];
+            }
+        }
+
+        auto new_a = pack_565(new_endpoints[0]);
+        auto new_b = pack_565(new_endpoints[1]);
+        auto indices = read_32(input + 4);
+
+        // DXT1 picks 3-color or 4-color mode by comparing the endpoints, so keep the same mode
+        if(dxt1) {
+            bool three_color = a <= b;
+            if(three_color ? (new_a > new_b) : (new_a < new_b)) {
+                std::swap(new_a, new_b);
+                std::uint32_t swapped = 0;
+                for(std::size_t i = 0; i < 16; i++) {
+                    std::uint32_t index = (indices >> (i * 2)) & 3;
+                    if(index < 2 || !three_color) {
+                        index ^= 1; // 0 <-> 1, and 2 <-> 3 in 4-color mode
+                    }
+                    swapped |= index << (i * 2);
+                }
+                indices = swapped;
+            }
+            else if(!three_color && new_a == new_b) {
+                indices = 0; // every color is the same, but equal endpoints would switch to 3-color mode
+            }
+        }
+
+        write_16(output, new_a);
+        write_16(output + 2, new_b);
+        write_32(output + 4, indices);
+        return true;
+    }
+
+    bool is_dxt_format(BitmapDataFormat format) noexcept {
+        return format == BitmapDataFormat::BITMAP_DATA_FORMAT_DXT1 || format == BitmapDataFormat::BITMAP_DATA_FORMAT_DXT3 || format == BitmapDataFormat::BITMAP_DATA_FORMAT_DXT5;
+    }
+
+    bool shuffle_dxt_blocks(std::byte *data, std::size_t size, BitmapDataFormat format, const PixelShuffle &shuffle) {
+        if(!is_dxt_format(format)) {
+            return false;
+        }
+
+        // Work out where each output channel comes from
+        ChannelSource sources[4];
+        for(std::size_t c = 0; c < 4; c++) {
+            auto source = shuffle.source[channel_offsets[c]];
+            sources[c].channel = -1;
+            sources[c].constant = shuffle.constant[channel_offsets[c]];
+            for(std::size_t s = 0; s < 4 && source >= 0; s++) {
+                if(channel_offsets[s] == static_cast<std::size_t>(source)) {
+                    sources[c].channel = static_cast<int>(s);
+                }
+            }
+        }
+
+        bool dxt1 = format == BitmapDataFormat::BITMAP_DATA_FORMAT_DXT1;
+        std::size_t block_size = dxt1 ? 8 : 16;
+        std::size_t block_count = size / block_size;
+        if(block_count * block_size != size) {
+            return false;
+        }
+
+        static constexpr const std::size_t blocks_per_job = 16384;
+        std::atomic<bool> exact = true;
+
+        LastResort::parallel_for((block_count + blocks_per_job - 1) / blocks_per_job, [&](std::size_t job) {
+            for(std::size_t b = job * blocks_per_job; b < block_count && b < (job + 1) * blocks_per_job && exact; b++) {
+                auto *block = reinterpret_cast<std::uint8_t *>(data) + b * block_size;
+
+                // What we need the block to decode to
+                Texel input[16], expected[16];
+                decode_block(block, format, input);
+                for(std::size_t i = 0; i < 16; i++) {
+                    for(std::size_t c = 0; c < 4; c++) {
+                        expected[i].channels[c] = sources[c].channel < 0 ? sources[c].constant : input[i].channels[sources[c].channel];
+                    }
+                }
+
+                // Build it
+                std::uint8_t output[16];
+                bool built;
+                if(dxt1) {
+                    built = shuffle_color_block(block, output, true, sources, expected);
+                }
+                else {
+                    built = shuffle_color_block(block + 8, output + 8, false, sources, expected);
+                    if(sources[CHANNEL_ALPHA].channel == CHANNEL_ALPHA) {
+                        std::memcpy(output, block, 8);
+                    }
+                    else if(format == BitmapDataFormat::BITMAP_DATA_FORMAT_DXT3) {
+                        built = built && encode_dxt3_alpha_block(expected, output);
+                    }
+                    else {
+                        built = built && encode_dxt5_alpha_block(expected, output);
+                    }
+                }
+
+                // And make sure it's exact
+                Texel result[16];
+                if(built) {
+                    decode_block(output, format, result);
+                    built = std::memcmp(result, expected, sizeof(result)) == 0;
+                }
+
+                if(!built) {
+                    exact = false;
+                    break;
+                }
+
+                std::memcpy(block, output, block_size);
+            }
+        });
+
+        return exact;
+    }
+}
@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__DXT_SWIZZLE_HPP
+#define LAST_RESORT__DXT_SWIZZLE_HPP
+
+#include <cstddef>
+#include <invader/tag/hek/header.hpp>
+#include "swizzle.hpp"
+
+namespace LastResort {
+    /**
+     * Get whether or not the format is DXT1, DXT3, or DXT5
+     * @param format format to check
+     * @return       true if DXT
+     */
+    bool is_dxt_format(Invader::HEK::BitmapDataFormat format) noexcept;
+
+    /**
+     * Apply a byte shuffle to DXT1/DXT3/DXT5 data by rewriting block endpoints, indices and alpha blocks, without
+     * decoding and re-encoding the bitmap.
+     *
+     * Every rewritten block is decoded and checked against the shuffled decoded input, so the result is exactly what
+     * decoding, shuffling and losslessly re-encoding would give. If any block cannot be represented exactly (e.g. a
+     * color channel would need per-pixel alpha values), this fails and the data should be converted the slow way.
+     *
+     * @param data    DXT blocks to modify; left in an unspecified state on failure
+     * @param size    size of the data in bytes
+     * @param format  DXT format of the data
+     * @param shuffle shuffle to apply
+     * @return        true if every block was shuffled exactly
+     */
+    bool shuffle_dxt_blocks(std::byte *data, std::size_t size, Invader::HEK::BitmapDataFormat format, const PixelShuffle &shuffle);
+}
+
+#endif
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__ERROR_HPP
+#define LAST_RESORT__ERROR_HPP
+
+#include <stdexcept>
+
+namespace LastResort {
+    /**
+     * Base class for everything a conversion can fail with
+     */
+    class ConversionError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    /**
+     * The tag could not be parsed or its data is inconsistent (e.g. out of bounds)
+     */
+    class InvalidTagError : public ConversionError {
+    public:
+        using ConversionError::ConversionError;
+    };
+
+    /**
+     * The action does not apply to this tag's class (e.g. converting a bitmap to Xbox ADPCM)
+     */
+    class WrongTagClassError : public ConversionError {
+    public:
+        using ConversionError::ConversionError;
+    };
+
+    /**
+     * The tag uses a format that cannot be converted
+     */
+    class UnsupportedFormatError : public ConversionError {
+    public:
+        using ConversionError::ConversionError;
+    };
+
+    /**
+     * Compressed data in the tag could not be decoded
+     */
+    class DecodeError : public ConversionError {
+    public:
+        using ConversionError::ConversionError;
+    };
+}
+
+#endif
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <invader/file/file.hpp>
+#include "file_io.hpp"
+
+#ifdef _WIN32
+#include <cstdio>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace LastResort {
+    std::optional<MappedFile> MappedFile::open(const std::filesystem::path &path) {
+        MappedFile file;
+
+        #ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0) {
+            return std::nullopt;
+        }
+
+        struct stat file_stat;
+        if(fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+            close(fd);
+            return std::nullopt;
+        }
+
+        // Empty files can't be mapped, but there's nothing to read anyway
+        if(file_stat.st_size > 0) {
+            void *mapping = mmap(nullptr, static_cast<std::size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapping != MAP_FAILED) {
+                file.mapping = reinterpret_cast<std::byte *>(mapping);
+                file.mapping_size = static_cast<std::size_t>(file_stat.st_size);
+                close(fd);
+                return file;
+            }
+        }
+        close(fd);
+        #endif
+
+        // Otherwise, just read it
+        auto data = Invader::File::open_file(path);
+        if(!data.has_value()) {
+            return std::nullopt;
+        }
+        file.fallback = std::move(*data);
+        return file;
+    }
+
+    MappedFile::MappedFile(MappedFile &&other) noexcept : mapping(other.mapping), mapping_size(other.mapping_size), fallback(std::move(other.fallback)) {
+        other.mapping = nullptr;
+        other.mapping_size = 0;
+    }
+
+    MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+        std::swap(this->mapping, other.mapping);
+        std::swap(this->mapping_size, other.mapping_size);
+        std::swap(this->fallback, other.fallback);
+        return *this;
+    }
+
+    MappedFile::~MappedFile() {
+        #ifndef _WIN32
+        if(this->mapping) {
+            munmap(this->mapping, this->mapping_size);
+        }
+        #endif
+    }
+
+    static bool file_contents_equal(const std::filesystem::path &path, const std::byte *data, std::size_t size) {
+        std::error_code ec;
+        auto existing_size = std::filesystem::file_size(path, ec);
+        if(ec || existing_size != size) {
+            return false;
+        }
+
+        auto existing = MappedFile::open(path);
+        return existing.has_value() && existing->size() == size && (size == 0 || std::memcmp(existing->data(), data, size) == 0);
+    }
+
+    WriteFileResult write_file_atomically(const std::filesystem::path &path, const std::byte *data, std::size_t size) {
+        if(file_contents_equal(path, data, size)) {
+            return WriteFileResult::WRITE_FILE_RESULT_UNCHANGED;
+        }
+
+        static std::atomic<std::size_t> temp_counter = 0;
+        auto temp_path = path;
+        std::error_code ec;
+
+        #ifndef _WIN32
+        temp_path += "." + std::to_string(getpid()) + "." + std::to_string(temp_counter++) + ".tmp";
+
+        // Keep the permissions of the file we're replacing
+        mode_t mode = 0666;
+        struct stat existing_stat;
+        if(stat(path.c_str(), &existing_stat) == 0) {
+            mode = existing_stat.st_mode & 07777;
+        }
+
+        int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL, mode);
+        if(fd < 0) {
+            return WriteFileResult::WRITE_FILE_RESULT_FAILED;
+        }
+
+        bool success = true;
+        for(std::size_t offset = 0; offset < size && success;) {
+            auto written = ::write(fd, data + offset, size - offset);
+            if(written < 0 && errno == EINTR) {
+                continue;
+            }
+            success = written > 0;
+            offset += success ? static_cast<std::size_t>(written) : 0;
+        }
+        success = success && fsync(fd) == 0;
+        success = close(fd) == 0 && success;
+
+        if(!success || rename(temp_path.c_str(), path.c_str()) != 0) {
+            unlink(temp_path.c_str());
+            return WriteFileResult::WRITE_FILE_RESULT_FAILED;
+        }
+
+        // Make sure the rename itself is on disk
+        auto parent = path.parent_path();
+        int directory_fd = ::open(parent.empty() ? "." : parent.c_str(), O_RDONLY);
+        if(directory_fd >= 0) {
+            fsync(directory_fd);
+            close(directory_fd);
+        }
+        #else
+        temp_path += "." + std::to_string(temp_counter++) + ".tmp";
+
+        std::FILE *file = _wfopen(temp_path.c_str(), L"wb");
+        if(!file) {
+            return WriteFileResult::WRITE_FILE_RESULT_FAILED;
+        }
+        bool success = std::fwrite(data, 1, size, file) == size;
+        success = std::fflush(file) == 0 && success;
+        success = std::fclose(file) == 0 && success;
+
+        if(success) {
+            std::filesystem::rename(temp_path, path, ec);
+            success = !ec;
+        }
+        if(!success) {
+            std::filesystem::remove(temp_path, ec);
+            return WriteFileResult::WRITE_FILE_RESULT_FAILED;
+        }
+        #endif
+
+        return WriteFileResult::WRITE_FILE_RESULT_WRITTEN;
+    }
+}
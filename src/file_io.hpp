@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__FILE_IO_HPP
+#define LAST_RESORT__FILE_IO_HPP
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace LastResort {
+    /**
+     * Read-only view of a whole file, memory-mapped where supported
+     */
+    class MappedFile {
+    public:
+        /**
+         * Open a file
+         * @param path path to the file
+         * @return     file, or std::nullopt if it could not be opened
+         */
+        static std::optional<MappedFile> open(const std::filesystem::path &path);
+
+        /**
+         * Get the contents of the file
+         * @return pointer to the contents
+         */
+        const std::byte *data() const noexcept {
+            return this->mapping ? this->mapping : this->fallback.data();
+        }
+
+        /**
+         * Get the size of the file
+         * @return size in bytes
+         */
+        std::size_t size() const noexcept {
+            return this->mapping ? this->mapping_size : this->fallback.size();
+        }
+
+        MappedFile(MappedFile &&other) noexcept;
+        MappedFile &operator=(MappedFile &&other) noexcept;
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+        ~MappedFile();
+
+    private:
+        MappedFile() = default;
+        std::byte *mapping = nullptr;
+        std::size_t mapping_size = 0;
+        std::vector<std::byte> fallback;
+    };
+
+    enum WriteFileResult {
+        /** The file was written */
+        WRITE_FILE_RESULT_WRITTEN,
+
+        /** The file already had these exact contents, so it was left alone */
+        WRITE_FILE_RESULT_UNCHANGED,
+
+        /** The file could not be written; the original file, if any, is untouched */
+        WRITE_FILE_RESULT_FAILED
+    };
+
+    /**
+     * Replace a file's contents all at once.
+     *
+     * The data is written to a temporary file in the same directory, flushed to disk, and then renamed over the
+     * destination, so the destination is never left partially written. If the destination already holds the same data,
+     * nothing is written.
+     *
+     * @param path path to write to
+     * @param data data to write
+     * @param size size of the data in bytes
+     * @return     result
+     */
+    WriteFileResult write_file_atomically(const std::filesystem::path &path, const std::byte *data, std::size_t size);
+}
+
+#endif
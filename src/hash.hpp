@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__HASH_HPP
+#define LAST_RESORT__HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace LastResort {
+    namespace Detail {
+        static constexpr const std::uint64_t HASH_PRIME_1 = 0x9E3779B185EBCA87ULL;
+        static constexpr const std::uint64_t HASH_PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+        static constexpr const std::uint64_t HASH_PRIME_3 = 0x165667B19E3779F9ULL;
+        static constexpr const std::uint64_t HASH_PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+        static constexpr const std::uint64_t HASH_PRIME_5 = 0x27D4EB2F165667C5ULL;
+
+        inline std::uint64_t rotate_left(std::uint64_t value, int bits) noexcept {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        inline std::uint64_t read_64(const std::uint8_t *data) noexcept {
+            std::uint64_t value = 0;
+            for(std::size_t i = 0; i < 8; i++) {
+                value |= static_cast<std::uint64_t>(data[i]) << (i * 8);
+            }
+            return value;
+        }
+
+        inline std::uint32_t read_32(const std::uint8_t *data) noexcept {
+            return static_cast<std::uint32_t>(data[0]) | (static_cast<std::uint32_t>(data[1]) << 8) | (static_cast<std::uint32_t>(data[2]) << 16) | (static_cast<std::uint32_t>(data[3]) << 24);
+        }
+
+        inline std::uint64_t hash_round(std::uint64_t accumulator, std::uint64_t input) noexcept {
+            return rotate_left(accumulator + input * HASH_PRIME_2, 31) * HASH_PRIME_1;
+        }
+
+        inline std::uint64_t hash_merge_round(std::uint64_t accumulator, std::uint64_t value) noexcept {
+            return (accumulator ^ hash_round(0, value)) * HASH_PRIME_1 + HASH_PRIME_4;
+        }
+    }
+
+    /**
+     * Hash a run of bytes with XXH64
+     * @param data data to hash
+     * @param size size of the data in bytes
+     * @param seed seed
+     * @return     hash
+     */
+    inline std::uint64_t hash_bytes(const void *data, std::size_t size, std::uint64_t seed = 0) noexcept {
+        using namespace Detail;
+
+        const auto *input = reinterpret_cast<const std::uint8_t *>(data);
+        const auto *end = input + size;
+        std::uint64_t hash;
+
+        if(size >= 32) {
+            std::uint64_t v1 = seed + HASH_PRIME_1 + HASH_PRIME_2;
+            std::uint64_t v2 = seed + HASH_PRIME_2;
+            std::uint64_t v3 = seed;
+            std::uint64_t v4 = seed - HASH_PRIME_1;
+
+            for(; input + 32 <= end; input += 32) {
+                v1 = hash_round(v1, read_64(input));
+                v2 = hash_round(v2, read_64(input + 8));
+                v3 = hash_round(v3, read_64(input + 16));
+                v4 = hash_round(v4, read_64(input + 24));
+            }
+
+            hash = rotate_left(v1, 1) + rotate_left(v2, 7) + rotate_left(v3, 12) + rotate_left(v4, 18);
+            hash = hash_merge_round(hash, v1);
+            hash = hash_merge_round(hash, v2);
+            hash = hash_merge_round(hash, v3);
+            hash = hash_merge_round(hash, v4);
+        }
+        else {
+            hash = seed + HASH_PRIME_5;
+        }
+
+        hash += static_cast<std::uint64_t>(size);
+
+        for(; input + 8 <= end; input += 8) {
+            hash ^= hash_round(0, read_64(input));
+            hash = rotate_left(hash, 27) * HASH_PRIME_1 + HASH_PRIME_4;
+        }
+        if(input + 4 <= end) {
+            hash ^= static_cast<std::uint64_t>(read_32(input)) * HASH_PRIME_1;
+            hash = rotate_left(hash, 23) * HASH_PRIME_2 + HASH_PRIME_3;
+            input += 4;
+        }
+        for(; input < end; input++) {
+            hash ^= (*input) * HASH_PRIME_5;
+            hash = rotate_left(hash, 11) * HASH_PRIME_1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= HASH_PRIME_2;
+        hash ^= hash >> 29;
+        hash *= HASH_PRIME_3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+}
+
+#endif
@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <invader/version.hpp>
+#include <invader/tag/parser/parser_struct.hpp>
+#include <invader/tag/parser/parser.hpp>
+#include <invader/tag/hek/header.hpp>
+#include <memory>
+#include <new>
+
+#include "last_resort.hpp"
+#include "parallel.hpp"
+#include "stats.hpp"
+
+namespace LastResort {
+    ConversionResult convert_tag_data(const std::byte *data, std::size_t size, const ConversionOptions &options) {
+        DiagnosticSink diagnostics;
+        DiagnosticScope diagnostic_scope(&diagnostics);
+        ThreadCountScope thread_count_scope(options.threads);
+        ConversionResult result;
+
+        if(size < sizeof(Invader::HEK::TagFileHeader)) {
+            throw InvalidTagError("Tag is too small to have a header");
+        }
+
+        // Invader reports problems with its own exceptions, so turn those into ours
+        std::unique_ptr<Invader::Parser::ParserStruct> tag_file;
+        try {
+            StageTimer parse_timer(Stage::STAGE_PARSE, size);
+            tag_file = Invader::Parser::ParserStruct::parse_hek_tag_file(data, size);
+        }
+        catch(std::bad_alloc &) {
+            throw;
+        }
+        catch(std::exception &e) {
+            throw InvalidTagError(std::string("Failed to parse tag: ") + e.what());
+        }
+
+        auto bitmap_options = options.bitmap_options;
+        bitmap_options.reuse_results = options.reuse_results;
+        auto sound_options = options.sound_options;
+        sound_options.reuse_results = options.reuse_results;
+
+        try {
+            switch(options.action) {
+                case LastResortAction::LAST_RESORT_ACTION_HUD_METER_SWAP:
+                    hud_meter_swap(dynamic_cast<Invader::Parser::Bitmap *>(tag_file.get()), bitmap_options);
+                    break;
+                case LastResortAction::LAST_RESORT_ACTION_MULTIPURPOSE_GBX_TO_XBOX:
+                    multi_gbx_to_xbox(dynamic_cast<Invader::Parser::Bitmap *>(tag_file.get()), bitmap_options);
+                    break;
+                case LastResortAction::LAST_RESORT_ACTION_MULTIPURPOSE_XBOX_TO_GBX:
+                    multi_xbox_to_gbx(dynamic_cast<Invader::Parser::Bitmap *>(tag_file.get()), bitmap_options);
+                    break;
+                case LastResortAction::LAST_RESORT_ACTION_BITMAP_PASSTHROUGH:
+                    bitmap_passthrough(dynamic_cast<Invader::Parser::Bitmap *>(tag_file.get()), bitmap_options);
+                    break;
+                case LastResortAction::LAST_RESORT_ACTION_SOUND_TO_XBOX_ADPCM:
+                    if(!sound_to_xbox_adpcm(dynamic_cast<Invader::Parser::Sound *>(tag_file.get()), sound_options)) {
+                        result.diagnostics = diagnostics.take();
+                        return result;
+                    }
+                    break;
+            }
+
+            StageTimer generate_timer(Stage::STAGE_GENERATE);
+            result.output = tag_file->generate_hek_tag_data(reinterpret_cast<const Invader::HEK::TagFileHeader *>(data)->tag_fourcc);
+            generate_timer.count(result.output.size());
+        }
+        catch(ConversionError &) {
+            throw;
+        }
+        catch(std::bad_alloc &) {
+            throw;
+        }
+        catch(std::exception &e) {
+            throw ConversionError(e.what());
+        }
+
+        result.status = ConversionStatus::CONVERSION_STATUS_CONVERTED;
+        result.diagnostics = diagnostics.take();
+        return result;
+    }
+
+    std::string conversion_settings(const ConversionOptions &options) {
+        auto &bitmap_options = options.bitmap_options;
+        std::string settings = "action=" + std::to_string(options.action);
+        if(bitmap_options.force_format.has_value()) {
+            auto &format = *bitmap_options.force_format;
+            settings += ";format=" + std::to_string(format.index()) + ":" + std::to_string(std::visit([](auto value) { return static_cast<int>(value); }, format));
+        }
+        settings += ";dither=" + std::to_string(bitmap_options.dither);
+        settings += ";mipmaps=" + std::to_string(bitmap_options.generate_mipmaps);
+        settings += ";gamma=" + std::to_string(bitmap_options.gamma_correct_mipmaps);
+        settings += ";fast-adpcm=" + std::to_string(options.sound_options.fast_adpcm);
+        settings += ";last-resort=" LAST_RESORT_VERSION;
+        settings += std::string(";invader=") + Invader::full_version();
+        return settings;
+    }
+}
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__LAST_RESORT_HPP
+#define LAST_RESORT__LAST_RESORT_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "actions.hpp"
+#include "diagnostics.hpp"
+#include "error.hpp"
+
+namespace LastResort {
+    struct ConversionOptions {
+        LastResortAction action = LastResortAction::LAST_RESORT_ACTION_BITMAP_PASSTHROUGH;
+        BitmapOptions bitmap_options;
+        SoundOptions sound_options;
+        std::size_t threads = 0; // 0 = use the value from set_thread_count()
+        bool reuse_results = false; // remember what was converted for later conversions in this process; worth it when converting many tags that may share data
+    };
+
+    enum ConversionStatus {
+        CONVERSION_STATUS_CONVERTED,
+        CONVERSION_STATUS_UNCHANGED
+    };
+
+    struct ConversionResult {
+        ConversionStatus status = ConversionStatus::CONVERSION_STATUS_UNCHANGED;
+        std::vector<std::byte> output; // empty if unchanged
+        std::vector<Diagnostic> diagnostics;
+    };
+
+    /**
+     * Convert a tag entirely in memory. Nothing is read, written, or printed, so this can be called from any number of
+     * threads at once.
+     * @param data    tag file data
+     * @param size    size of the tag file data in bytes
+     * @param options conversion options
+     * @return        converted tag file data and everything worth telling the user about
+     * @throws        ConversionError (or a subclass) if the tag could not be converted
+     */
+    ConversionResult convert_tag_data(const std::byte *data, std::size_t size, const ConversionOptions &options);
+
+    /**
+     * Describe everything besides the input tag that affects the output of a conversion, for use as a cache key
+     * @param options conversion options
+     * @return        settings string
+     */
+    std::string conversion_settings(const ConversionOptions &options);
+}
+
+#endif
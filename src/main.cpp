@@ -5,350 +5,593 @@
 #include <invader/printf.hpp>
 #include <invader/file/file.hpp>
 #include <invader/tag/parser/parser_struct.hpp>
-#include <invader/tag/parser/parser.hpp>
-#include <invader/tag/hek/header.hpp>
-#include <invader/sound/sound_encoder.hpp>
-#include <invader/sound/sound_reader.hpp>
-#include <invader/bitmap/pixel.hpp>
-#include <invader/bitmap/bitmap_encode.hpp>
-#include <invader/tag/hek/class/bitmap.hpp>
 #include <optional>
 #include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <limits>
+#include <algorithm>
 
-enum LastResortAction {
-    LAST_RESORT_ACTION_HUD_METER_SWAP,
-    LAST_RESORT_ACTION_MULTIPURPOSE_GBX_TO_XBOX,
-    LAST_RESORT_ACTION_MULTIPURPOSE_XBOX_TO_GBX,
-    LAST_RESORT_ACTION_BITMAP_PASSTHROUGH,
-    LAST_RESORT_ACTION_SOUND_TO_XBOX_ADPCM
+#include "last_resort.hpp"
+#include "parallel.hpp"
+#include "conversion_cache.hpp"
+#include "dependencies.hpp"
+#include "file_io.hpp"
+#include "stats.hpp"
+#include "scan.hpp"
+#include "mipmap.hpp"
+
+using LastResort::LastResortAction;
+
+enum ScanFormat {
+    SCAN_FORMAT_LIST,
+    SCAN_FORMAT_JSON
 };
 
-using PreferredFormat = std::variant<Invader::HEK::BitmapDataFormat, Invader::HEK::BitmapFormat>;
+enum StatsFormat {
+    STATS_FORMAT_TEXT,
+    STATS_FORMAT_JSON
+};
+
+struct LastResortOptions {
+    std::optional<LastResortAction> action;
+    bool use_filesystem_path = false;
+    LastResort::BitmapOptions bitmap_options;
+    LastResort::SoundOptions sound_options;
+    std::filesystem::path tags = "tags";
+    std::optional<std::filesystem::path> output_tags;
+    bool overwrite_tags = false;
+    std::optional<std::filesystem::path> tag_list;
+    bool recursive = false;
+    bool walk = false;
+    bool reuse_results = false;
+    std::size_t threads = 0;
+    std::optional<std::filesystem::path> cache;
+    std::uintmax_t cache_size = 0;
+    std::optional<ScanFormat> scan;
+    std::optional<StatsFormat> stats;
+    std::optional<std::filesystem::path> stats_file;
+};
+
+enum ConvertTagResult {
+    CONVERT_TAG_RESULT_CONVERTED,
+    CONVERT_TAG_RESULT_UNCHANGED,
+    CONVERT_TAG_RESULT_FAILED
+};
+
+static const char *action_name(LastResortAction action) {
+    switch(action) {
+        case LastResortAction::LAST_RESORT_ACTION_HUD_METER_SWAP:
+            return "hud-meter-swap";
+        case LastResortAction::LAST_RESORT_ACTION_MULTIPURPOSE_GBX_TO_XBOX:
+            return "multi-gbx-to-xbox";
+        case LastResortAction::LAST_RESORT_ACTION_MULTIPURPOSE_XBOX_TO_GBX:
+            return "multi-xbox-to-gbx";
+        case LastResortAction::LAST_RESORT_ACTION_BITMAP_PASSTHROUGH:
+            return "bitmap-passthrough";
+        case LastResortAction::LAST_RESORT_ACTION_SOUND_TO_XBOX_ADPCM:
+            return "sound-to-xbox-adpcm";
+    }
+    return "unknown";
+}
+
+static const LastResortAction ALL_ACTIONS[] = {
+    LastResortAction::LAST_RESORT_ACTION_HUD_METER_SWAP,
+    LastResortAction::LAST_RESORT_ACTION_MULTIPURPOSE_GBX_TO_XBOX,
+    LastResortAction::LAST_RESORT_ACTION_MULTIPURPOSE_XBOX_TO_GBX,
+    LastResortAction::LAST_RESORT_ACTION_BITMAP_PASSTHROUGH,
+    LastResortAction::LAST_RESORT_ACTION_SOUND_TO_XBOX_ADPCM
+};
 
-void iterate_through_bitmap_tag(Invader::Parser::Bitmap *bitmap, const std::optional<PreferredFormat> &force_format, bool dither, bool generate_mipmaps, void (*modify_pixel)(Invader::Pixel &pixel)) {
-    if(bitmap == nullptr) {
-        eprintf_error("Invalid tag provided for this action");
-        throw std::exception();
+static const char *action_tag_extension(LastResortAction action) {
+    switch(action) {
+        case LastResortAction::LAST_RESORT_ACTION_SOUND_TO_XBOX_ADPCM:
+            return ".sound";
+        default:
+            return ".bitmap";
     }
+}
+
+// Everything the library needs to know to convert a tag
+static LastResort::ConversionOptions conversion_options(const LastResortOptions &last_resort_options, LastResortAction action) {
+    LastResort::ConversionOptions options;
+    options.action = action;
+    options.bitmap_options = last_resort_options.bitmap_options;
+    options.sound_options = last_resort_options.sound_options;
+    options.reuse_results = last_resort_options.reuse_results;
+    return options;
+}
+
+static bool write_output_tag(const LastResortOptions &last_resort_options, const std::string &path, const std::vector<std::byte> &data) {
+    auto output_file_path = last_resort_options.output_tags.value() / path;
     
-    std::vector<std::byte> new_bitmap_data;
-    for(auto &i : bitmap->bitmap_data) {
-        auto size_of_bitmap = Invader::BitmapEncode::bitmap_data_size(i.width, i.height, i.depth, i.mipmap_count, i.format, i.type);
-        bool should_regenerate_mipmaps = generate_mipmaps && i.type == Invader::HEK::BitmapDataType::BITMAP_DATA_TYPE_2D_TEXTURE && i.depth == 1;
-        
-        if(i.pixel_data_offset >= bitmap->processed_pixel_data.size() || size_of_bitmap > bitmap->processed_pixel_data.size() || i.pixel_data_offset + size_of_bitmap > bitmap->processed_pixel_data.size()) {
-            eprintf_error("Bitmap tag invalid - bitmap data out of bounds");
-            throw std::exception();
+    std::error_code ec;
+    std::filesystem::create_directories(output_file_path.parent_path(), ec); // make dirs
+    
+    // Write to a temporary file and rename it into place; if the output is already identical, leave it alone
+    LastResort::StageTimer timer(LastResort::Stage::STAGE_WRITE, data.size());
+    if(LastResort::write_file_atomically(output_file_path, data.data(), data.size()) == LastResort::WriteFileResult::WRITE_FILE_RESULT_FAILED) {
+        eprintf_error("Failed to write to %s", output_file_path.string().c_str());
+        return false;
+    }
+    
+    return true;
+}
+
+static ConvertTagResult convert_tag(const LastResortOptions &last_resort_options, LastResortAction action, const std::string &path, LastResort::ConversionCache *cache) {
+    // Open that
+    std::filesystem::path file_path = last_resort_options.tags / path;
+    // Map it rather than copying it; since outputs are replaced by renaming, this stays valid even when overwriting the input
+    LastResort::StageTimer read_timer(LastResort::Stage::STAGE_READ);
+    auto file_data = LastResort::MappedFile::open(file_path);
+    if(!file_data.has_value()) {
+        eprintf_error("Failed to open %s", file_path.string().c_str());
+        return ConvertTagResult::CONVERT_TAG_RESULT_FAILED;
+    }
+    read_timer.count(file_data->size());
+    read_timer.finish();
+    
+    // If we already did this exact conversion, reuse it
+    auto options = conversion_options(last_resort_options, action);
+    std::optional<LastResort::ConversionCacheKey> cache_key;
+    if(cache) {
+        LastResort::StageTimer cache_timer(LastResort::Stage::STAGE_CACHE, file_data->size());
+        cache_key = LastResort::ConversionCacheKey::make(file_data->data(), file_data->size(), LastResort::conversion_settings(options));
+        auto cached = cache->load(*cache_key);
+        cache_timer.finish();
+        if(cached.has_value()) {
+            if(cached->empty()) {
+                oprintf("No conversion necessary; sound tag already Xbox ADPCM\n");
+                return ConvertTagResult::CONVERT_TAG_RESULT_UNCHANGED;
+            }
+            return write_output_tag(last_resort_options, path, *cached) ? ConvertTagResult::CONVERT_TAG_RESULT_CONVERTED : ConvertTagResult::CONVERT_TAG_RESULT_FAILED;
         }
-        
-        auto *data = bitmap->processed_pixel_data.data() + i.pixel_data_offset;
-        
-        // If regenerate mipmaps, reduce mipmap count to 0
-        if(should_regenerate_mipmaps) {
-            i.mipmap_count = 0;
+    }
+    
+    LastResort::ConversionResult result;
+    try {
+        result = LastResort::convert_tag_data(file_data->data(), file_data->size(), options);
+    }
+    catch(std::exception &e) {
+        eprintf_error("Failed to convert %s: %s", file_path.string().c_str(), e.what());
+        return ConvertTagResult::CONVERT_TAG_RESULT_FAILED;
+    }
+    
+    for(auto &i : result.diagnostics) {
+        LastResort::print_diagnostic(i);
+    }
+    
+    if(result.status == LastResort::ConversionStatus::CONVERSION_STATUS_UNCHANGED) {
+        oprintf("No conversion necessary; sound tag already Xbox ADPCM\n");
+        if(cache) {
+            cache->store(*cache_key, {});
         }
+        return ConvertTagResult::CONVERT_TAG_RESULT_UNCHANGED;
+    }
+    
+    if(cache) {
+        cache->store(*cache_key, result.output);
+    }
+    
+    return write_output_tag(last_resort_options, path, result.output) ? ConvertTagResult::CONVERT_TAG_RESULT_CONVERTED : ConvertTagResult::CONVERT_TAG_RESULT_FAILED;
+}
+
+// Check if forcing a format would change a bitmap data that is already in the given format
+static bool bitmap_format_matches(const LastResort::PreferredFormat &force_format, Invader::HEK::BitmapDataFormat format) {
+    using namespace Invader::HEK;
+    
+    if(auto *force_data_format = std::get_if<BitmapDataFormat>(&force_format)) {
+        return *force_data_format == format;
+    }
+    
+    // For a format class, the exact format depends on the pixels, so anything the class can pick is fine
+    switch(std::get<BitmapFormat>(force_format)) {
+        case BitmapFormat::BITMAP_FORMAT_COMPRESSED_WITH_COLOR_KEY_TRANSPARENCY:
+            return format == BitmapDataFormat::BITMAP_DATA_FORMAT_DXT1;
+        case BitmapFormat::BITMAP_FORMAT_COMPRESSED_WITH_EXPLICIT_ALPHA:
+            return format == BitmapDataFormat::BITMAP_DATA_FORMAT_DXT1 || format == BitmapDataFormat::BITMAP_DATA_FORMAT_DXT3;
+        case BitmapFormat::BITMAP_FORMAT_COMPRESSED_WITH_INTERPOLATED_ALPHA:
+            return format == BitmapDataFormat::BITMAP_DATA_FORMAT_DXT1 || format == BitmapDataFormat::BITMAP_DATA_FORMAT_DXT5;
+        case BitmapFormat::BITMAP_FORMAT_16_BIT_COLOR:
+            return format == BitmapDataFormat::BITMAP_DATA_FORMAT_R5G6B5 || format == BitmapDataFormat::BITMAP_DATA_FORMAT_A1R5G5B5 || format == BitmapDataFormat::BITMAP_DATA_FORMAT_A4R4G4B4;
+        case BitmapFormat::BITMAP_FORMAT_32_BIT_COLOR:
+            return format == BitmapDataFormat::BITMAP_DATA_FORMAT_X8R8G8B8 || format == BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8;
+        case BitmapFormat::BITMAP_FORMAT_MONOCHROME:
+            return format == BitmapDataFormat::BITMAP_DATA_FORMAT_A8 || format == BitmapDataFormat::BITMAP_DATA_FORMAT_Y8 || format == BitmapDataFormat::BITMAP_DATA_FORMAT_AY8 || format == BitmapDataFormat::BITMAP_DATA_FORMAT_A8Y8;
+        default:
+            return false;
+    }
+}
+
+// Decide from a scan whether running an action on a tag would change it
+static bool tag_needs_action(const LastResortOptions &last_resort_options, LastResortAction action, const LastResort::TagScan &scan) {
+    using namespace Invader::HEK;
+    
+    switch(action) {
+        case LastResortAction::LAST_RESORT_ACTION_SOUND_TO_XBOX_ADPCM:
+            return scan.sound.has_value() && scan.sound->permutations_to_convert > 0;
         
-        // Get it!
-        std::vector<std::byte> new_data = Invader::BitmapEncode::encode_bitmap(data, i.format, Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8, i.width, i.height, i.depth, i.type, i.mipmap_count);
+        // Whether the channels were already swapped can't be told without looking at the pixels
+        case LastResortAction::LAST_RESORT_ACTION_HUD_METER_SWAP:
+        case LastResortAction::LAST_RESORT_ACTION_MULTIPURPOSE_GBX_TO_XBOX:
+        case LastResortAction::LAST_RESORT_ACTION_MULTIPURPOSE_XBOX_TO_GBX:
+            return !scan.bitmap_data.empty();
         
-        // Figure out the bitmap to force it to if we need to force the bitmap
-        if(force_format.has_value()) {
-            auto &value = *force_format;
-            auto *force_format = std::get_if<Invader::HEK::BitmapDataFormat>(&value);
-            if(force_format) {
-                i.format = *force_format;
-            }
-            else {
-                auto *force_format_type = std::get_if<Invader::HEK::BitmapFormat>(&value);
-                if(force_format_type) {
-                    auto &meme = *force_format_type;
-                    i.format = Invader::BitmapEncode::most_efficient_format(new_data.data(), i.width, i.height, i.depth, meme, i.type, 0);
+        // Passing through only does something if the format or mipmaps change
+        case LastResortAction::LAST_RESORT_ACTION_BITMAP_PASSTHROUGH: {
+            auto &bitmap_options = last_resort_options.bitmap_options;
+            for(auto &i : scan.bitmap_data) {
+                if(bitmap_options.force_format.has_value() && !bitmap_format_matches(*bitmap_options.force_format, i.format)) {
+                    return true;
                 }
-                else {
-                    eprintf_error("what");
-                    std::terminate();
+                if(bitmap_options.generate_mipmaps && LastResort::can_generate_mipmaps(i.type, i.depth) && i.mipmap_count < LastResort::full_mipmap_count(i.width, i.height, i.depth, i.type)) {
+                    return true;
                 }
             }
+            return false;
+        }
+    }
+    
+    return false;
+}
+
+// Read just the headers of every tag and report which ones need converting; a tag with no action is checked against all of them
+static int scan_tags(const LastResortOptions &last_resort_options, const std::vector<std::string> &tag_paths, const std::vector<std::optional<LastResortAction>> &tag_actions) {
+    using namespace Invader::HEK;
+    
+    std::vector<std::optional<LastResort::TagScan>> scans(tag_paths.size());
+    LastResort::parallel_for(tag_paths.size(), [&last_resort_options, &tag_paths, &scans](std::size_t i) {
+        auto file_path = last_resort_options.tags / tag_paths[i];
+        auto file_data = LastResort::MappedFile::open(file_path);
+        if(!file_data.has_value()) {
+            eprintf_error("Failed to open %s", file_path.string().c_str());
+            return;
+        }
+        scans[i] = LastResort::scan_tag(file_data->data(), file_data->size());
+        if(!scans[i].has_value()) {
+            eprintf_error("Failed to scan %s", file_path.string().c_str());
+        }
+    });
+    
+    std::size_t failed = 0;
+    if(*last_resort_options.scan == ScanFormat::SCAN_FORMAT_LIST) {
+        // One tag per line, so the list can be passed right back in with --tag-list
+        for(std::size_t i = 0; i < tag_paths.size(); i++) {
+            if(!scans[i].has_value()) {
+                failed++;
+            }
+            else if(tag_actions[i].has_value() && tag_needs_action(last_resort_options, *tag_actions[i], *scans[i])) {
+                oprintf("%s\n", Invader::File::preferred_path_to_halo_path(tag_paths[i]).c_str());
+            }
+        }
+    }
+    else {
+        std::printf("{\n  \"tags\": [");
+        for(std::size_t i = 0; i < tag_paths.size(); i++) {
+            std::printf("%s\n    { \"path\": \"%s\"", i == 0 ? "" : ",", LastResort::json_escape(Invader::File::preferred_path_to_halo_path(tag_paths[i])).c_str());
+            if(!scans[i].has_value()) {
+                std::printf(", \"valid\": false }");
+                failed++;
+                continue;
+            }
             
-            // Set palettized flag if needed
-            if(i.format == Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_P8_BUMP) {
-                i.flags |= Invader::HEK::BitmapDataFlagsFlag::BITMAP_DATA_FLAGS_FLAG_PALETTIZED;
+            auto &scan = *scans[i];
+            std::printf(", \"valid\": true");
+            if(scan.sound.has_value()) {
+                std::printf(", \"sound\": { \"format\": \"%s\", \"channels\": %d, \"flags\": %u, \"permutations_to_convert\": %zu }", SoundFormat_to_string(scan.sound->format), scan.sound->channel_count == SoundChannelCount::SOUND_CHANNEL_COUNT_MONO ? 1 : 2, static_cast<unsigned int>(scan.sound->flags), scan.sound->permutations_to_convert);
             }
-            else {
-                i.flags &= ~Invader::HEK::BitmapDataFlagsFlag::BITMAP_DATA_FLAGS_FLAG_PALETTIZED;
+            if(scan.tag_fourcc == TagFourCC::TAG_FOURCC_BITMAP) {
+                std::printf(", \"bitmap_data\": [");
+                for(std::size_t b = 0; b < scan.bitmap_data.size(); b++) {
+                    auto &data = scan.bitmap_data[b];
+                    auto format = data.format < BitmapDataFormat::BITMAP_DATA_FORMAT_ENUM_COUNT ? BitmapDataFormat_to_string(data.format) : "invalid";
+                    std::printf("%s{ \"format\": \"%s\", \"type\": \"%s\", \"width\": %u, \"height\": %u, \"depth\": %u, \"mipmaps\": %u }", b == 0 ? "" : ", ", format, BitmapDataType_to_string(data.type), data.width, data.height, data.depth, data.mipmap_count);
+                }
+                std::printf("]");
             }
             
-            // Set compressed flag if needed
-            if(i.format == Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_DXT1 || i.format == Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_DXT3 || i.format == Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_DXT5) {
-                i.flags |= Invader::HEK::BitmapDataFlagsFlag::BITMAP_DATA_FLAGS_FLAG_COMPRESSED;
+            std::printf(", \"needs\": [");
+            const char *separator = "";
+            std::vector<LastResortAction> actions;
+            if(tag_actions[i].has_value()) {
+                actions.emplace_back(*tag_actions[i]);
             }
             else {
-                i.flags &= ~Invader::HEK::BitmapDataFlagsFlag::BITMAP_DATA_FLAGS_FLAG_COMPRESSED;
+                actions.assign(std::begin(ALL_ACTIONS), std::end(ALL_ACTIONS));
             }
+            for(auto action : actions) {
+                if(tag_needs_action(last_resort_options, action, scan)) {
+                    std::printf("%s\"%s\"", separator, action_name(action));
+                    separator = ", ";
+                }
+            }
+            std::printf("] }");
         }
-        
-        // Go through each pixel
-        auto *first_pixel = reinterpret_cast<Invader::Pixel *>(new_data.data());
-        auto *last_pixel = reinterpret_cast<Invader::Pixel *>(new_data.data() + new_data.size());
-        for(auto *pixel = first_pixel; pixel < last_pixel; pixel++) {
-            modify_pixel(*pixel);
+        std::printf("\n  ]\n}\n");
+    }
+    
+    return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Decide what to do with a bitmap or sound found by walking dependencies, if anything
+static std::optional<LastResortAction> walk_action(const LastResortOptions &last_resort_options, Invader::HEK::TagFourCC tag_fourcc, const std::optional<LastResort::ReferenceRole> &role) {
+    std::optional<LastResortAction> action;
+    if(role.has_value()) {
+        switch(*role) {
+            case LastResort::ReferenceRole::REFERENCE_ROLE_HUD_METER:
+                action = LastResortAction::LAST_RESORT_ACTION_HUD_METER_SWAP;
+                break;
+            case LastResort::ReferenceRole::REFERENCE_ROLE_MULTIPURPOSE_MAP:
+                action = last_resort_options.action == LastResortAction::LAST_RESORT_ACTION_MULTIPURPOSE_XBOX_TO_GBX ? LastResortAction::LAST_RESORT_ACTION_MULTIPURPOSE_XBOX_TO_GBX : LastResortAction::LAST_RESORT_ACTION_MULTIPURPOSE_GBX_TO_XBOX;
+                break;
+            case LastResort::ReferenceRole::REFERENCE_ROLE_SOUND:
+                action = LastResortAction::LAST_RESORT_ACTION_SOUND_TO_XBOX_ADPCM;
+                break;
         }
+    }
+    
+    // If an action was given, only do that one; passing through can be done to any bitmap
+    if(last_resort_options.action.has_value()) {
+        if(*last_resort_options.action == LastResortAction::LAST_RESORT_ACTION_BITMAP_PASSTHROUGH) {
+            if(tag_fourcc != Invader::HEK::TagFourCC::TAG_FOURCC_BITMAP) {
+                return std::nullopt;
+            }
+            return LastResortAction::LAST_RESORT_ACTION_BITMAP_PASSTHROUGH;
+        }
+        if(action != last_resort_options.action) {
+            return std::nullopt;
+        }
+    }
+    
+    return action;
+}
+
+// Follow every tag reference from the root tags, finding each bitmap and sound along the way and what to do with it. Every
+// tag is read just once, no matter how many tags reference it. Returns false if a root tag could not be read.
+static bool walk_dependencies(const LastResortOptions &last_resort_options, const std::vector<std::string> &roots, std::vector<std::string> &tag_paths, std::vector<std::optional<LastResortAction>> &tag_actions) {
+    using namespace Invader::HEK;
+    
+    struct FoundTag {
+        std::string path;
+        TagFourCC tag_fourcc;
+        std::optional<LastResort::ReferenceRole> role;
+        bool conflicting = false;
+    };
+    
+    std::vector<FoundTag> found;
+    std::unordered_map<std::string, std::size_t> found_indices;
+    std::unordered_set<std::string> visited(roots.begin(), roots.end());
+    std::vector<std::string> frontier = roots;
+    bool roots_read = true;
+    
+    for(bool reading_roots = true; !frontier.empty(); reading_roots = false) {
+        // Every tag at this depth can be read at once
+        std::vector<std::optional<std::vector<LastResort::TagReference>>> references(frontier.size());
+        LastResort::parallel_for(frontier.size(), [&last_resort_options, &frontier, &references](std::size_t i) {
+            auto file_path = last_resort_options.tags / frontier[i];
+            auto file_data = LastResort::MappedFile::open(file_path);
+            if(!file_data.has_value()) {
+                eprintf_warn("Failed to open %s", file_path.string().c_str());
+                return;
+            }
+            try {
+                auto tag_file = Invader::Parser::ParserStruct::parse_hek_tag_file(file_data->data(), file_data->size());
+                references[i] = LastResort::find_tag_references(*tag_file);
+            }
+            catch(std::exception &) {
+                eprintf_warn("Failed to parse %s", file_path.string().c_str());
+            }
+        });
         
-        // Generate mipmaps
-        if(should_regenerate_mipmaps && (i.width > 1 || i.height > 1)) {
-            std::size_t old_mw = i.width;
-            std::size_t old_mh = i.height;
-            std::size_t mw = old_mw / 2;
-            std::size_t mh = old_mh / 2;
-            static const constexpr std::size_t min_dimension = 1;
-            auto *last_mipmap = first_pixel;
+        // Then go through what they reference in order so the result doesn't depend on which tag was read first
+        std::vector<std::string> next_frontier;
+        for(std::size_t i = 0; i < frontier.size(); i++) {
+            if(!references[i].has_value()) {
+                if(reading_roots) {
+                    roots_read = false;
+                }
+                continue;
+            }
             
-            while(true) {
-                std::vector<Invader::Pixel> mipmap(mw * mh);
-                for(std::size_t y = 0; y < mh; y++) {
-                    for(std::size_t x = 0; x < mw; x++) {
-                        std::size_t red = 0, green = 0, blue = 0, alpha = 0, count = 0;
-                        
-                        std::size_t old_mipmap_x = x * 2;
-                        std::size_t old_mipmap_y = y * 2;
-                        
-                        for(std::size_t omy = old_mipmap_y; omy < old_mh && omy < old_mipmap_y + 2; omy++) {
-                            for(std::size_t omx = old_mipmap_x; omx < old_mw && omx < old_mipmap_x + 2; omx++) {
-                                auto &color = last_mipmap[omx + omy * old_mw];
-                                alpha += color.alpha;
-                                red += color.red;
-                                green += color.green;
-                                blue += color.blue;
-                                count++;
-                            }
+            for(auto &reference : *references[i]) {
+                if(reference.tag_fourcc == TagFourCC::TAG_FOURCC_BITMAP || reference.tag_fourcc == TagFourCC::TAG_FOURCC_SOUND) {
+                    auto [index, inserted] = found_indices.emplace(reference.path, found.size());
+                    if(inserted) {
+                        found.push_back(FoundTag { reference.path, reference.tag_fourcc, reference.role });
+                    }
+                    else {
+                        auto &tag = found[index->second];
+                        if(!tag.role.has_value()) {
+                            tag.role = reference.role;
                         }
-                        
-                        if(count) {
-                            auto &mc = mipmap[x + y * mw];
-                            mc.alpha = alpha / count;
-                            mc.green = green / count;
-                            mc.red = red / count;
-                            mc.blue = blue / count;
+                        else if(reference.role.has_value() && *reference.role != *tag.role) {
+                            tag.conflicting = true;
                         }
                     }
                 }
                 
-                auto old_size = new_data.size();
-                new_data.insert(new_data.end(), reinterpret_cast<std::byte *>(mipmap.data()), reinterpret_cast<std::byte *>(mipmap.data() + mipmap.size()));
-                last_mipmap = reinterpret_cast<Invader::Pixel *>(new_data.data() + old_size);
-                old_mh = mh;
-                old_mw = mw;
-                mw = std::max(mw / 2, min_dimension);
-                mh = std::max(mh / 2, min_dimension);
-                
-                i.mipmap_count++;
-                
-                if(old_mw == 1 && old_mh == 1) {
-                    break;
+                // Bitmaps don't reference anything, so don't bother reading them
+                if(reference.tag_fourcc != TagFourCC::TAG_FOURCC_BITMAP && visited.insert(reference.path).second) {
+                    next_frontier.emplace_back(reference.path);
                 }
             }
         }
-        
-        if(!should_regenerate_mipmaps && generate_mipmaps) {
-            eprintf_warn("Unable to regenerate mipmaps for this bitmap type");
-        }
-        
-        // Done
-        new_data = Invader::BitmapEncode::encode_bitmap(new_data.data(), Invader::HEK::BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8, i.format, i.width, i.height, i.depth, i.type, i.mipmap_count, dither, dither, dither, dither);
-        
-        i.pixel_data_offset = new_bitmap_data.size();
-        new_bitmap_data.insert(new_bitmap_data.end(), new_data.begin(), new_data.end());
+        frontier = std::move(next_frontier);
     }
     
-    bitmap->processed_pixel_data = new_bitmap_data;
+    for(auto &tag : found) {
+        if(tag.conflicting) {
+            eprintf_warn("Skipping %s since it is used as more than one kind of bitmap", Invader::File::preferred_path_to_halo_path(tag.path).c_str());
+            continue;
+        }
+        auto action = walk_action(last_resort_options, tag.tag_fourcc, tag.role);
+        if(action.has_value()) {
+            tag_paths.emplace_back(tag.path);
+            tag_actions.emplace_back(action);
+        }
+    }
     
-    oprintf_success("Modified %zu bitmap%s", bitmap->bitmap_data.size(), bitmap->bitmap_data.size() == 1 ? "" : "s");
+    return roots_read;
 }
 
-void hud_meter_swap(Invader::Parser::Bitmap *bitmap, const std::optional<PreferredFormat> &force_format, bool dither, bool generate_mipmaps) {
-    iterate_through_bitmap_tag(bitmap, force_format, dither, generate_mipmaps, [](Invader::Pixel &pixel) {
-        std::uint8_t mask = pixel.convert_to_y8();
-        std::uint8_t meter = pixel.alpha;
-        
-        pixel.alpha = mask;
-        pixel.red = meter;
-        pixel.green = meter;
-        pixel.blue = meter;
-    });
+static const char *convert_tag_result_name(ConvertTagResult result) {
+    switch(result) {
+        case ConvertTagResult::CONVERT_TAG_RESULT_CONVERTED:
+            return "converted";
+        case ConvertTagResult::CONVERT_TAG_RESULT_UNCHANGED:
+            return "unchanged";
+        default:
+            return "failed";
+    }
 }
 
-void multi_gbx_to_xbox(Invader::Parser::Bitmap *bitmap, const std::optional<PreferredFormat> &force_format, bool dither, bool generate_mipmaps) {
-    iterate_through_bitmap_tag(bitmap, force_format, dither, generate_mipmaps, [](Invader::Pixel &pixel) {
-        Invader::Pixel new_pixel;
-        new_pixel.green = pixel.green; // self illumination is passed through
-        new_pixel.alpha = 0xFF; // pixel.red; // auxilary is memed to 0xFF because DXT1                                                                                                           
-        new_pixel.red = pixel.blue; // detail/specular is memed
-        new_pixel.blue = pixel.alpha; // color change is memed 
-        pixel = new_pixel;
-    });
+// Write the stats for each tag followed by the stats for the whole run
+static bool write_stats(const LastResortOptions &last_resort_options, const std::vector<std::string> &tag_paths, const std::vector<ConvertTagResult> &results, const std::vector<LastResort::ConversionStats> &tag_stats) {
+    if(!last_resort_options.stats.has_value()) {
+        return true;
+    }
+    
+    std::FILE *file = stdout;
+    if(last_resort_options.stats_file.has_value()) {
+        file = std::fopen(last_resort_options.stats_file->string().c_str(), "w");
+        if(!file) {
+            eprintf_error("Failed to open %s", last_resort_options.stats_file->string().c_str());
+            return false;
+        }
+    }
+    else {
+        std::fflush(stdout);
+    }
+    
+    LastResort::ConversionStats total;
+    for(auto &i : tag_stats) {
+        total.merge(i);
+    }
+    
+    if(*last_resort_options.stats == StatsFormat::STATS_FORMAT_JSON) {
+        std::fprintf(file, "{\n  \"tags\": [");
+        for(std::size_t i = 0; i < tag_paths.size(); i++) {
+            std::fprintf(file, "%s\n    { \"path\": \"%s\", \"result\": \"%s\", \"stages\": ", i == 0 ? "" : ",", LastResort::json_escape(Invader::File::preferred_path_to_halo_path(tag_paths[i])).c_str(), convert_tag_result_name(results[i]));
+            tag_stats[i].print_json(file);
+            std::fprintf(file, " }");
+        }
+        std::fprintf(file, "\n  ],\n  \"total\": ");
+        total.print_json(file);
+        std::fprintf(file, "\n}\n");
+    }
+    else {
+        for(std::size_t i = 0; i < tag_paths.size(); i++) {
+            auto heading = "Stats for " + Invader::File::preferred_path_to_halo_path(tag_paths[i]) + " (" + convert_tag_result_name(results[i]) + "):";
+            tag_stats[i].print_text(file, heading.c_str());
+        }
+        if(tag_paths.size() > 1) {
+            auto heading = "Stats for all " + std::to_string(tag_paths.size()) + " tags:";
+            total.print_text(file, heading.c_str());
+        }
+    }
+    
+    if(file != stdout) {
+        std::fclose(file);
+    }
+    else {
+        std::fflush(stdout);
+    }
+    
+    return true;
 }
 
-void multi_xbox_to_gbx(Invader::Parser::Bitmap *bitmap, const std::optional<PreferredFormat> &force_format, bool dither, bool generate_mipmaps) {
-    iterate_through_bitmap_tag(bitmap, force_format, dither, generate_mipmaps, [](Invader::Pixel &pixel) {
-        Invader::Pixel new_pixel;
-        new_pixel.green = pixel.green; // self illumination is passed through
-        new_pixel.red = 0x00; // pixel.alpha; // auxilary is memed to 0x00
-        new_pixel.blue = pixel.red; // detail/specular is memed
-        new_pixel.alpha = pixel.blue; // color change is memed 
-        pixel = new_pixel;
-    });
+// Match a path against a pattern where * matches any run of characters (including directory separators) and ? matches one character
+static bool glob_match(const char *pattern, const char *string) {
+    const char *star = nullptr;
+    const char *star_match = nullptr;
+    
+    while(*string) {
+        if(*pattern == '?' || *pattern == *string) {
+            pattern++;
+            string++;
+        }
+        else if(*pattern == '*') {
+            star = pattern++;
+            star_match = string;
+        }
+        else if(star) {
+            pattern = star + 1;
+            string = ++star_match;
+        }
+        else {
+            return false;
+        }
+    }
+    
+    while(*pattern == '*') {
+        pattern++;
+    }
+    
+    return *pattern == 0;
 }
 
-bool sound_to_xbox_adpcm(Invader::Parser::Sound *sound) {
-    if(sound == nullptr) {
-        eprintf_error("Invalid tag provided for this action");
-        throw std::exception();
+static bool has_wildcard(const char *argument) {
+    return std::strchr(argument, '*') != nullptr || std::strchr(argument, '?') != nullptr;
+}
+
+// Find all tags of the given extension in the tags directory, optionally matching a pattern
+static void find_tags(const std::filesystem::path &tags, const char *extension, const char *pattern, std::vector<std::string> &tag_paths) {
+    std::string generic_pattern;
+    if(pattern) {
+        generic_pattern = pattern;
+        std::replace(generic_pattern.begin(), generic_pattern.end(), '\\', '/');
     }
     
-    std::size_t converted = 0;
-    sound->format = Invader::HEK::SoundFormat::SOUND_FORMAT_XBOX_ADPCM;
-    std::size_t channel_count = sound->channel_count == Invader::HEK::SoundChannelCount::SOUND_CHANNEL_COUNT_MONO ? 1 : 2;
-    std::size_t sample_rate = sound->sample_rate == Invader::HEK::SoundSampleRate::SOUND_SAMPLE_RATE_22050_HZ ? 22050 : 44100;
-    bool split = sound->flags & Invader::HEK::SoundFlagsFlag::SOUND_FLAGS_FLAG_SPLIT_LONG_SOUND_INTO_PERMUTATIONS;
-    
-    for(auto &i : sound->pitch_ranges) {
-        std::vector<Invader::Parser::SoundPermutation> permutations_memes;
-        
-        auto re_encode_real_permutation = [&converted, &split, &channel_count, &sample_rate, &i, &permutations_memes](std::size_t permutation) {
-            auto &base_permutation = i.permutations[permutation];
-            auto &new_permutation = permutations_memes.emplace_back(base_permutation);
-            auto format = new_permutation.format;
-            new_permutation.samples.clear();
-            new_permutation.buffer_size = 0;
-            new_permutation.format = Invader::HEK::SoundFormat::SOUND_FORMAT_XBOX_ADPCM;
-            
-            // Append it!
-            auto append_permutation = [&channel_count, &sample_rate, &new_permutation, &format](auto &permutation) {
-                std::vector<std::byte> samples;
-                
-                switch(format) {
-                    case Invader::HEK::SoundFormat::SOUND_FORMAT_16_BIT_PCM:
-                        samples = Invader::SoundEncoder::encode_to_xbox_adpcm(Invader::SoundReader::sound_from_16_bit_pcm_big_endian(permutation.samples.data(), permutation.samples.size(), channel_count, sample_rate).pcm, 16, channel_count);
-                        break;
-                    case Invader::HEK::SoundFormat::SOUND_FORMAT_OGG_VORBIS: {
-                        auto sound = Invader::SoundReader::sound_from_ogg(permutation.samples.data(), permutation.samples.size());
-                        samples = Invader::SoundEncoder::encode_to_xbox_adpcm(sound.pcm, sound.bits_per_sample, channel_count);
-                        break;
-                    }
-                    case Invader::HEK::SoundFormat::SOUND_FORMAT_XBOX_ADPCM:
-                        samples = permutation.samples;
-                        break;
-                    default:
-                        eprintf_error("Unknown format");
-                        throw std::exception();
-                }
-                
-                new_permutation.samples.insert(new_permutation.samples.end(), samples.begin(), samples.end());
-            };
-            
-            // Done
-            std::size_t next_permutation = permutation;
-            do {
-                if(split && next_permutation > i.permutations.size()) {
-                    eprintf_error("Next permutation is out of bounds");
-                    throw std::exception();
-                }
-                
-                auto &p = i.permutations[next_permutation];
-                append_permutation(p);
-                next_permutation = p.next_permutation_index;
-            } while(split && next_permutation != NULL_INDEX);
-            
-            if(base_permutation.format != Invader::HEK::SoundFormat::SOUND_FORMAT_XBOX_ADPCM) {
-                converted++;
-            }
-        };
-        
-        // First pass: go through each real permutation
-        if(split) {
-            if(i.actual_permutation_count > i.permutations.size()) {
-                eprintf_error("Actual permutation count for %s is wrong", i.name.string);
-                throw std::exception();
-            }
-            
-            for(std::size_t j = 0; j < i.actual_permutation_count; j++) {
-                re_encode_real_permutation(j);
-            }
+    std::error_code ec;
+    for(auto i = std::filesystem::recursive_directory_iterator(tags, ec); !ec && i != std::filesystem::recursive_directory_iterator(); i.increment(ec)) {
+        if(!i->is_regular_file() || i->path().extension() != extension) {
+            continue;
         }
         
-        // If we don't have them split into permutations, just go throguh all of them
-        else {
-            for(std::size_t j = 0; j < i.permutations.size(); j++) {
-                re_encode_real_permutation(j);
-            }
+        auto relative_path = i->path().lexically_relative(tags);
+        if(pattern && !glob_match(generic_pattern.c_str(), relative_path.generic_string().c_str())) {
+            continue;
         }
         
-        i.permutations.clear();
-        
-        // Copy in new permutations
-        i.permutations = std::move(permutations_memes);
-        
-        // Now split them!
-        if(split) {
-            for(std::size_t j = 0; j < i.actual_permutation_count; j++) {
-                auto samples = std::move(i.permutations[j].samples);
-                auto *sample_data = samples.data();
-                auto sample_size = samples.size();
-                auto template_sound = i.permutations[j];
-                
-                auto *permutation_to_modify = &i.permutations[j];
-                static const constexpr std::size_t max_permutation_bytes = 65520; // precomputed
-                
-                // Add each one at a time
-                for(std::size_t q = 0; q < sample_size; q += max_permutation_bytes) {
-                    if(q) {
-                        permutation_to_modify->next_permutation_index = i.permutations.size();
-                        permutation_to_modify = &i.permutations.emplace_back(template_sound);
-                    }
-                    permutation_to_modify->samples = std::vector<std::byte>(sample_data + q, sample_data + q + std::min(sample_size - q, max_permutation_bytes));
-                    permutation_to_modify->next_permutation_index = NULL_INDEX;
-                }
-            }
-        }
+        tag_paths.emplace_back(relative_path.string());
     }
     
-    if(converted > 0) {
-        oprintf_success("Converted %zu permutation%s into Xbox ADPCM", converted, converted == 1 ? "" : "s");
-        return true;
-    }
-    else {
-        return false;
+    if(ec) {
+        eprintf_warn("Failed to fully search %s: %s", tags.string().c_str(), ec.message().c_str());
     }
 }
 
 int main(int argc, const char **argv) {
     using namespace Invader;
     
-    struct LastResortOptions {
-        std::optional<LastResortAction> action;
-        bool use_filesystem_path = false;
-        bool dither = false;
-        bool generate_mipmaps = false;
-        std::filesystem::path tags = "tags";
-        std::optional<std::filesystem::path> output_tags;
-        std::optional<PreferredFormat> force_format;
-        bool overwrite_tags = false;
-    } last_resort_options;
+    LastResortOptions last_resort_options;
     
     std::vector<CommandLineOption> options;
     options.emplace_back("type", 'T', 1, "Set the type of action to take. Can be: hud-meter-swap, multi-gbx-to-xbox, multi-xbox-to-gbx, sound-to-xbox-adpcm, bitmap-passthrough", "<action>");
     options.emplace_back("bitmap-format", 'F', 1, "Force the bitmap format to be something else (can be dxt1, dxt3, dxt5, monochrome, 32-bit, 16-bit, a8r8g8b8, x8r8g8b8, r5g6b5, a1r5g5b5, a4r4g4b4, a8, y8, ay8, a8y8, p8)", "<format>");
     options.emplace_back("fs-path", 'P', 0, "Use a filesystem path for the tag.");
-    options.emplace_back("dither", 'd', 0, "Use dithering when possible.");
+    options.emplace_back("dither", 'd', 0, "Use dithering when possible. Big bitmaps are dithered in strips of rows, and error is not carried from one strip to the next.");
+    options.emplace_back("fast-adpcm", 'A', 0, "Encode Xbox ADPCM with our own SIMD encoder instead of Invader's. This is much faster, but the output is not identical.");
     options.emplace_back("overwrite", 'O', 0, "Allow overwriting of the tag in the tags directory. This cannot be used with --overwrite-tags.");
     options.emplace_back("tags", 't', 1, "Set the tags directory.", "<dir>");
     options.emplace_back("output-tags", 'o', 1, "Set the output tags directory. If you don't specify anything, the input tags directory is used, but only if you pass --overwrite.", "<dir>");
-    options.emplace_back("regenerate-mipmaps", 'M', 0, "Regenerate mipmaps. Note that this will disregard all post-processing settings on the bitmap tag. Also, this can only be used with 2D textures.");
+    options.emplace_back("regenerate-mipmaps", 'M', 0, "Regenerate mipmaps. Note that this will disregard all post-processing settings on the bitmap tag.");
+    options.emplace_back("gamma-correct-mipmaps", 'G', 0, "Average colors in linear space (gamma 2.2) when regenerating mipmaps. This can only be used with --regenerate-mipmaps.");
+    options.emplace_back("tag-list", 'l', 1, "Also convert every tag listed in this file (one tag path per line; empty lines and lines starting with # are ignored).", "<file>");
+    options.emplace_back("recursive", 'r', 0, "Also convert every tag in the tags directory that the action applies to (.bitmap or .sound).");
+    options.emplace_back("walk", 'w', 0, "Treat the given tags as root tags (e.g. a .scenario) and convert every bitmap and sound they reference, directly or through other tags, each with the action it needs: HUD meter bitmaps get hud-meter-swap, shader multipurpose maps get multi-gbx-to-xbox, and sounds get sound-to-xbox-adpcm. With -T, only that action is done (multi-xbox-to-gbx converts multipurpose maps the other way, and bitmap-passthrough applies to every bitmap).");
+    options.emplace_back("threads", 'j', 1, "Set the number of threads to use. By default, this is the number of CPU threads.", "<count>");
+    options.emplace_back("cache", 'C', 1, "Cache conversions in this directory and reuse them when a tag is converted again with the same settings.", "<dir>");
+    options.emplace_back("cache-size", 'S', 1, "Set the maximum size of the cache in MiB, removing the least recently used conversions first. By default, there is no limit.", "<MiB>");
+    options.emplace_back("scan", 'n', 1, "Don't convert anything. Instead, read just the headers of the tags and show which ones the action would change. Can be: list (one tag per line, usable with --tag-list), json (every tag with its formats and the actions it needs; -T is optional)", "<format>");
+    options.emplace_back("stats", 's', 1, "Time each stage of every conversion and count the bytes, pixels, and samples it processed, then show this for each tag and for the whole run. Can be: text, json", "<format>");
+    options.emplace_back("stats-file", 'R', 1, "Write the stats to this file instead of standard output.", "<file>");
 
-    static constexpr char DESCRIPTION[] = "Convince a tag to work with the Xbox version of Halo when nothing else works.";
-    static constexpr char USAGE[] = "[options] -T <action> -o <dir> <tag.class>";
+    static constexpr char DESCRIPTION[] = "Convince a tag to work with the Xbox version of Halo when nothing else works. Tag paths can use * and ? wildcards to convert many tags at once.";
+    static constexpr char USAGE[] = "[options] -T <action> -o <dir> <tag.class> [<tag.class> ...]";
     
-    auto remaining_arguments = CommandLineOption::parse_arguments<LastResortOptions &>(argc, argv, options, USAGE, DESCRIPTION, 1, 1, last_resort_options, [](char opt, const auto &arguments, auto &last_resort_options) {
+    auto remaining_arguments = CommandLineOption::parse_arguments<LastResortOptions &>(argc, argv, options, USAGE, DESCRIPTION, 0, std::numeric_limits<std::size_t>::max(), last_resort_options, [](char opt, const auto &arguments, auto &last_resort_options) {
         switch(opt) {
             case 'T':
                 if(std::strcmp(arguments[0], "hud-meter-swap") == 0) {
@@ -375,18 +618,24 @@ int main(int argc, const char **argv) {
                 last_resort_options.use_filesystem_path = true;
                 break;
             case 'M':
-                last_resort_options.generate_mipmaps = true;
+                last_resort_options.bitmap_options.generate_mipmaps = true;
+                break;
+            case 'G':
+                last_resort_options.bitmap_options.gamma_correct_mipmaps = true;
                 break;
             case 'd':
-                last_resort_options.dither = true;
+                last_resort_options.bitmap_options.dither = true;
+                break;
+            case 'A':
+                last_resort_options.sound_options.fast_adpcm = true;
                 break;
             case 'F':
                 try {
-                    last_resort_options.force_format = Invader::HEK::BitmapDataFormat_from_string(arguments[0]);
+                    last_resort_options.bitmap_options.force_format = Invader::HEK::BitmapDataFormat_from_string(arguments[0]);
                 }
                 catch(std::exception &) {
                     try {
-                        last_resort_options.force_format = Invader::HEK::BitmapFormat_from_string(arguments[0]);
+                        last_resort_options.bitmap_options.force_format = Invader::HEK::BitmapFormat_from_string(arguments[0]);
                     }
                     catch(std::exception &) {
                         eprintf_error("Unknown format: %s", arguments[0]);
@@ -403,12 +652,72 @@ int main(int argc, const char **argv) {
             case 'O':
                 last_resort_options.overwrite_tags = true;
                 break;
+            case 'l':
+                last_resort_options.tag_list = arguments[0];
+                break;
+            case 'r':
+                last_resort_options.recursive = true;
+                break;
+            case 'w':
+                last_resort_options.walk = true;
+                break;
+            case 'j': {
+                char *end = nullptr;
+                auto threads = std::strtoul(arguments[0], &end, 10);
+                if(*arguments[0] == 0 || *end != 0 || threads == 0) {
+                    eprintf_error("Invalid thread count: %s", arguments[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                last_resort_options.threads = threads;
+                break;
+            }
+            case 'C':
+                last_resort_options.cache = arguments[0];
+                break;
+            case 'n':
+                if(std::strcmp(arguments[0], "list") == 0) {
+                    last_resort_options.scan = ScanFormat::SCAN_FORMAT_LIST;
+                }
+                else if(std::strcmp(arguments[0], "json") == 0) {
+                    last_resort_options.scan = ScanFormat::SCAN_FORMAT_JSON;
+                }
+                else {
+                    eprintf_error("Unknown scan format: %s", arguments[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
+            case 's':
+                if(std::strcmp(arguments[0], "text") == 0) {
+                    last_resort_options.stats = StatsFormat::STATS_FORMAT_TEXT;
+                }
+                else if(std::strcmp(arguments[0], "json") == 0) {
+                    last_resort_options.stats = StatsFormat::STATS_FORMAT_JSON;
+                }
+                else {
+                    eprintf_error("Unknown stats format: %s", arguments[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
+            case 'R':
+                last_resort_options.stats_file = arguments[0];
+                break;
+            case 'S': {
+                char *end = nullptr;
+                auto cache_size = std::strtoull(arguments[0], &end, 10);
+                if(*arguments[0] == 0 || *end != 0) {
+                    eprintf_error("Invalid cache size: %s", arguments[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                last_resort_options.cache_size = static_cast<std::uintmax_t>(cache_size) * 1024 * 1024;
+                break;
+            }
             default:
                 break;
         }
     });
     
-    if(!last_resort_options.action.has_value()) {
+    bool scan_all_actions = last_resort_options.scan == ScanFormat::SCAN_FORMAT_JSON;
+    if(!last_resort_options.action.has_value() && !scan_all_actions && !last_resort_options.walk) {
         eprintf_error("No action was specified. Use -h for more information.");
         return EXIT_FAILURE;
     }
@@ -418,76 +727,193 @@ int main(int argc, const char **argv) {
         return EXIT_FAILURE;
     }
     
+    if(last_resort_options.bitmap_options.gamma_correct_mipmaps && !last_resort_options.bitmap_options.generate_mipmaps) {
+        eprintf_error("--gamma-correct-mipmaps requires --regenerate-mipmaps. Use -h for more information.");
+        return EXIT_FAILURE;
+    }
+    
+    if(last_resort_options.walk && last_resort_options.recursive) {
+        eprintf_error("--walk and --recursive cannot be used together. Use -h for more information.");
+        return EXIT_FAILURE;
+    }
+    
+    if(last_resort_options.stats_file.has_value() && !last_resort_options.stats.has_value()) {
+        eprintf_error("--stats-file requires --stats. Use -h for more information.");
+        return EXIT_FAILURE;
+    }
+    
     if(last_resort_options.overwrite_tags) {
         last_resort_options.output_tags = last_resort_options.tags;
     }
     
-    if(!last_resort_options.output_tags.has_value()) {
+    if(!last_resort_options.output_tags.has_value() && !last_resort_options.scan.has_value()) {
         eprintf_error("No output tags directory was specified. Use --overwrite to overwrite instead.");
         return EXIT_FAILURE;
     }
     
-    std::string path;
+    LastResort::set_thread_count(last_resort_options.threads);
     
-    if(last_resort_options.use_filesystem_path) {
-        auto path_maybe = Invader::File::file_path_to_tag_path(remaining_arguments[0], last_resort_options.tags);
-        if(path_maybe.has_value() && std::filesystem::exists(remaining_arguments[0])) {
-            path = path_maybe.value();
+    // Gather every tag we're going to convert
+    std::vector<const char *> extensions;
+    if(last_resort_options.walk) {
+        extensions.emplace_back(".scenario");
+    }
+    else if(last_resort_options.action.has_value()) {
+        extensions.emplace_back(action_tag_extension(*last_resort_options.action));
+    }
+    else {
+        extensions = { ".bitmap", ".sound" };
+    }
+    bool batch = remaining_arguments.size() != 1 || last_resort_options.tag_list.has_value() || last_resort_options.recursive;
+    std::vector<std::string> tag_paths;
+    
+    for(auto *argument : remaining_arguments) {
+        if(last_resort_options.use_filesystem_path) {
+            auto path_maybe = Invader::File::file_path_to_tag_path(argument, last_resort_options.tags);
+            if(path_maybe.has_value() && std::filesystem::exists(argument)) {
+                tag_paths.emplace_back(File::halo_path_to_preferred_path(path_maybe.value()));
+            }
+            else {
+                eprintf_error("Failed to find a valid tag %s in the tags directory", argument);
+                return EXIT_FAILURE;
+            }
+        }
+        else if(has_wildcard(argument)) {
+            batch = true;
+            for(auto *extension : extensions) {
+                find_tags(last_resort_options.tags, extension, argument, tag_paths);
+            }
         }
         else {
-            eprintf_error("Failed to find a valid tag %s in the tags directory", remaining_arguments[0]);
+            tag_paths.emplace_back(File::halo_path_to_preferred_path(argument));
+        }
+    }
+    
+    if(last_resort_options.tag_list.has_value()) {
+        std::ifstream list(*last_resort_options.tag_list);
+        if(!list.is_open()) {
+            eprintf_error("Failed to open %s", last_resort_options.tag_list->string().c_str());
             return EXIT_FAILURE;
         }
+        
+        std::string line;
+        while(std::getline(list, line)) {
+            auto first = line.find_first_not_of(" \t\r");
+            auto last = line.find_last_not_of(" \t\r");
+            if(first == std::string::npos || line[first] == '#') {
+                continue;
+            }
+            tag_paths.emplace_back(File::halo_path_to_preferred_path(line.substr(first, last - first + 1)));
+        }
     }
-    else {
-        path = File::halo_path_to_preferred_path(remaining_arguments[0]);
+    
+    if(last_resort_options.recursive) {
+        for(auto *extension : extensions) {
+            find_tags(last_resort_options.tags, extension, nullptr, tag_paths);
+        }
     }
     
-    // Open that
-    std::filesystem::path file_path = last_resort_options.tags / Invader::File::halo_path_to_preferred_path(path);
-    auto file_data = Invader::File::open_file(file_path);
-    if(!file_data.has_value()) {
-        eprintf_error("Failed to open %s", file_path.string().c_str());
+    // Don't convert anything twice
+    std::vector<std::string> unique_tag_paths;
+    std::unordered_set<std::string> seen_tag_paths;
+    unique_tag_paths.reserve(tag_paths.size());
+    for(auto &i : tag_paths) {
+        if(seen_tag_paths.insert(i).second) {
+            unique_tag_paths.emplace_back(std::move(i));
+        }
+    }
+    tag_paths = std::move(unique_tag_paths);
+    
+    if(tag_paths.empty()) {
+        eprintf_error("No tags were found to convert. Use -h for more information.");
         return EXIT_FAILURE;
     }
     
-    try {
-        auto tag_file = Invader::Parser::ParserStruct::parse_hek_tag_file(file_data->data(), file_data->size());
-        switch(*last_resort_options.action) {
-            case LastResortAction::LAST_RESORT_ACTION_HUD_METER_SWAP:
-                hud_meter_swap(dynamic_cast<Invader::Parser::Bitmap *>(tag_file.get()), last_resort_options.force_format, last_resort_options.dither, last_resort_options.generate_mipmaps);
-                break;
-            case LastResortAction::LAST_RESORT_ACTION_MULTIPURPOSE_GBX_TO_XBOX:
-                multi_gbx_to_xbox(dynamic_cast<Invader::Parser::Bitmap *>(tag_file.get()), last_resort_options.force_format, last_resort_options.dither, last_resort_options.generate_mipmaps);
-                break;
-            case LastResortAction::LAST_RESORT_ACTION_MULTIPURPOSE_XBOX_TO_GBX:
-                multi_xbox_to_gbx(dynamic_cast<Invader::Parser::Bitmap *>(tag_file.get()), last_resort_options.force_format, last_resort_options.dither, last_resort_options.generate_mipmaps);
+    // Swap the root tags for everything they reference
+    std::vector<std::optional<LastResortAction>> tag_actions(tag_paths.size(), last_resort_options.action);
+    if(last_resort_options.walk) {
+        auto roots = std::move(tag_paths);
+        tag_paths.clear();
+        tag_actions.clear();
+        if(!walk_dependencies(last_resort_options, roots, tag_paths, tag_actions)) {
+            eprintf_error("Failed to read the root tags");
+            return EXIT_FAILURE;
+        }
+        batch = true;
+    }
+    
+    if(last_resort_options.scan.has_value()) {
+        return scan_tags(last_resort_options, tag_paths, tag_actions);
+    }
+    
+    if(tag_paths.empty()) {
+        oprintf("Nothing referenced by the root tags needs converting\n");
+        return EXIT_SUCCESS;
+    }
+    
+    std::optional<LastResort::ConversionCache> cache;
+    if(last_resort_options.cache.has_value()) {
+        cache.emplace(*last_resort_options.cache, last_resort_options.cache_size);
+    }
+    auto *cache_ptr = cache.has_value() ? &*cache : nullptr;
+    
+    auto finish_cache = [&cache]() {
+        if(cache.has_value()) {
+            cache->evict();
+            oprintf("Cache: %zu hit%s, %zu miss%s\n", cache->get_hits(), cache->get_hits() == 1 ? "" : "s", cache->get_misses(), cache->get_misses() == 1 ? "" : "es");
+        }
+    };
+    
+    // Tags converted together often share bitmaps and sounds, so remember what was converted; one tag can't benefit
+    last_resort_options.reuse_results = batch;
+    
+    // Only collect stats if we're going to show them
+    std::vector<LastResort::ConversionStats> tag_stats(last_resort_options.stats.has_value() ? tag_paths.size() : 0);
+    std::vector<ConvertTagResult> results(tag_paths.size(), ConvertTagResult::CONVERT_TAG_RESULT_FAILED);
+    auto convert_tag_at = [&last_resort_options, &tag_paths, &tag_actions, &results, &cache_ptr, &tag_stats](std::size_t i) {
+        LastResort::StatsScope stats_scope(tag_stats.empty() ? nullptr : &tag_stats[i]);
+        results[i] = convert_tag(last_resort_options, *tag_actions[i], tag_paths[i], cache_ptr);
+    };
+    
+    // Just one tag? Do it the simple way
+    if(!batch) {
+        convert_tag_at(0);
+        finish_cache();
+        bool stats_written = write_stats(last_resort_options, tag_paths, results, tag_stats);
+        return results[0] == ConvertTagResult::CONVERT_TAG_RESULT_FAILED || !stats_written ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    
+    // Otherwise, spread the tags across the worker threads
+    LastResort::parallel_for(tag_paths.size(), convert_tag_at);
+    
+    std::size_t converted = 0, unchanged = 0, failed = 0;
+    for(std::size_t i = 0; i < tag_paths.size(); i++) {
+        const char *status;
+        switch(results[i]) {
+            case ConvertTagResult::CONVERT_TAG_RESULT_CONVERTED:
+                status = "converted";
+                converted++;
                 break;
-            case LastResortAction::LAST_RESORT_ACTION_BITMAP_PASSTHROUGH:
-                iterate_through_bitmap_tag(dynamic_cast<Invader::Parser::Bitmap *>(tag_file.get()), last_resort_options.force_format, last_resort_options.dither, last_resort_options.generate_mipmaps, [](auto &) {});
+            case ConvertTagResult::CONVERT_TAG_RESULT_UNCHANGED:
+                status = "unchanged";
+                unchanged++;
                 break;
-            case LastResortAction::LAST_RESORT_ACTION_SOUND_TO_XBOX_ADPCM:
-                if(!sound_to_xbox_adpcm(dynamic_cast<Invader::Parser::Sound *>(tag_file.get()))) {
-                    oprintf("No conversion necessary; sound tag already Xbox ADPCM\n");
-                    std::exit(EXIT_SUCCESS);
-                }
+            default:
+                status = "FAILED";
+                failed++;
                 break;
         }
-        
-        auto tag_file_saved = tag_file->generate_hek_tag_data(reinterpret_cast<const Invader::HEK::TagFileHeader *>(file_data->data())->tag_fourcc);
-        
-        auto output_file_path = last_resort_options.output_tags.value() / Invader::File::halo_path_to_preferred_path(path);
-        
-        std::error_code ec;
-        std::filesystem::create_directories(output_file_path.parent_path(), ec); // make dirs
-        
-        if(!Invader::File::save_file(output_file_path, tag_file_saved)) {
-            eprintf_error("Failed to write to %s", output_file_path.string().c_str());
-            return EXIT_FAILURE;
+        if(last_resort_options.walk) {
+            oprintf("%-10s %s (%s)\n", status, File::preferred_path_to_halo_path(tag_paths[i]).c_str(), action_name(*tag_actions[i]));
+        }
+        else {
+            oprintf("%-10s %s\n", status, File::preferred_path_to_halo_path(tag_paths[i]).c_str());
         }
     }
-    catch(std::exception &e) {
-        eprintf_error("Failed to parse %s", file_path.string().c_str());
-        return EXIT_FAILURE;
-    }
+    
+    oprintf("Converted %zu, unchanged %zu, failed %zu of %zu tag%s\n", converted, unchanged, failed, tag_paths.size(), tag_paths.size() == 1 ? "" : "s");
+    finish_cache();
+    bool stats_written = write_stats(last_resort_options, tag_paths, results, tag_stats);
+    
+    return failed > 0 || !stats_written ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,218 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "mipmap.hpp"
+#include "parallel.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define LAST_RESORT_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace LastResort {
+    using BitmapDataType = Invader::HEK::BitmapDataType;
+
+    struct MipmapLevelSize {
+        std::size_t width;
+        std::size_t height;
+        std::size_t depth;
+    };
+
+    static std::size_t face_count(BitmapDataType type) noexcept {
+        return type == BitmapDataType::BITMAP_DATA_TYPE_CUBE_MAP ? 6 : 1;
+    }
+
+    static MipmapLevelSize next_level(const MipmapLevelSize &size, BitmapDataType type) noexcept {
+        return {
+            std::max<std::size_t>(size.width / 2, 1),
+            std::max<std::size_t>(size.height / 2, 1),
+            type == BitmapDataType::BITMAP_DATA_TYPE_3D_TEXTURE ? std::max<std::size_t>(size.depth / 2, 1) : 1
+        };
+    }
+
+    static std::size_t level_pixel_count(const MipmapLevelSize &size, BitmapDataType type) noexcept {
+        return size.width * size.height * size.depth * face_count(type);
+    }
+
+    bool can_generate_mipmaps(BitmapDataType type, std::size_t depth) noexcept {
+        switch(type) {
+            case BitmapDataType::BITMAP_DATA_TYPE_2D_TEXTURE:
+            case BitmapDataType::BITMAP_DATA_TYPE_CUBE_MAP:
+                return depth == 1;
+            case BitmapDataType::BITMAP_DATA_TYPE_3D_TEXTURE:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    std::size_t full_mipmap_count(std::size_t width, std::size_t height, std::size_t depth, BitmapDataType type) noexcept {
+        std::size_t largest = std::max(width, height);
+        if(type == BitmapDataType::BITMAP_DATA_TYPE_3D_TEXTURE) {
+            largest = std::max(largest, depth);
+        }
+
+        std::size_t count = 0;
+        while(largest > 1) {
+            largest /= 2;
+            count++;
+        }
+        return count;
+    }
+
+    std::size_t mipmap_chain_pixel_count(std::size_t width, std::size_t height, std::size_t depth, BitmapDataType type, std::size_t mipmap_count) noexcept {
+        MipmapLevelSize size = { width, height, type == BitmapDataType::BITMAP_DATA_TYPE_3D_TEXTURE ? depth : 1 };
+        std::size_t total = level_pixel_count(size, type);
+        for(std::size_t m = 0; m < mipmap_count; m++) {
+            size = next_level(size, type);
+            total += level_pixel_count(size, type);
+        }
+        return total;
+    }
+
+    // 8-bit gamma <-> 16-bit linear lookup tables (gamma 2.2) so gamma-correct filtering stays in integer math
+    struct GammaTables {
+        std::uint16_t to_linear[256];
+        std::uint8_t to_gamma[65536];
+
+        GammaTables() {
+            for(std::size_t i = 0; i < sizeof(this->to_linear) / sizeof(*this->to_linear); i++) {
+                this->to_linear[i] = static_cast<std::uint16_t>(std::lround(std::pow(i / 255.0, 2.2) * 65535.0));
+            }
+            for(std::size_t i = 0; i < sizeof(this->to_gamma) / sizeof(*this->to_gamma); i++) {
+                this->to_gamma[i] = static_cast<std::uint8_t>(std::lround(std::pow(i / 65535.0, 1.0 / 2.2) * 255.0));
+            }
+        }
+    };
+
+    static const GammaTables &gamma_tables() {
+        static const GammaTables tables;
+        return tables;
+    }
+
+    // Average any footprint of up to 2x2x2 pixels. This handles the edges of odd and 1-pixel-wide levels.
+    template <bool gamma_correct> static void filter_row(const Invader::Pixel *source, const MipmapLevelSize &source_size, std::size_t z, std::size_t y, Invader::Pixel *destination, std::size_t destination_width, bool filter_depth) {
+        std::size_t x_count = std::min<std::size_t>(source_size.width, 2);
+        std::size_t y_count = std::min<std::size_t>(source_size.height - y * 2, 2);
+        std::size_t z_count = filter_depth ? std::min<std::size_t>(source_size.depth - z * 2, 2) : 1;
+        std::size_t slice_size = source_size.width * source_size.height;
+        const auto *first_row = source + (filter_depth ? z * 2 : z) * slice_size + y * 2 * source_size.width;
+        const GammaTables *tables = gamma_correct ? &gamma_tables() : nullptr;
+
+        for(std::size_t x = 0; x < destination_width; x++) {
+            std::uint32_t red = 0, green = 0, blue = 0, alpha = 0;
+            std::uint32_t count = 0;
+
+            for(std::size_t sz = 0; sz < z_count; sz++) {
+                for(std::size_t sy = 0; sy < y_count; sy++) {
+                    const auto *row = first_row + sz * slice_size + sy * source_size.width;
+                    for(std::size_t sx = x * 2; sx < x * 2 + x_count && sx < source_size.width; sx++) {
+                        auto &color = row[sx];
+                        if constexpr(gamma_correct) {
+                            red += tables->to_linear[color.red];
+                            green += tables->to_linear[color.green];
+                            blue += tables->to_linear[color.blue];
+                        }
+                        else {
+                            red += color.red;
+                            green += color.green;
+                            blue += color.blue;
+                        }
+                        alpha += color.alpha;
+                        count++;
+                    }
+                }
+            }
+
+            auto &mc = destination[x];
+            if constexpr(gamma_correct) {
+                mc.red = tables->to_gamma[red / count];
+                mc.green = tables->to_gamma[green / count];
+                mc.blue = tables->to_gamma[blue / count];
+            }
+            else {
+                mc.red = static_cast<std::uint8_t>(red / count);
+                mc.green = static_cast<std::uint8_t>(green / count);
+                mc.blue = static_cast<std::uint8_t>(blue / count);
+            }
+            mc.alpha = static_cast<std::uint8_t>(alpha / count);
+        }
+    }
+
+    // Average full 2x2 blocks from two rows, rounding down
+    static void filter_row_2x2(const Invader::Pixel *row0, const Invader::Pixel *row1, Invader::Pixel *destination, std::size_t destination_width) {
+        std::size_t x = 0;
+
+        #ifdef LAST_RESORT_SSE2
+        // Two output pixels at a time: widen to 16 bits per channel, add rows, add neighboring pixels, then shift
+        auto zero = _mm_setzero_si128();
+        for(; x + 2 <= destination_width; x += 2) {
+            auto top = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 2));
+            auto bottom = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 2));
+            auto left = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+            auto right = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+            left = _mm_add_epi16(left, _mm_srli_si128(left, 8));
+            right = _mm_add_epi16(right, _mm_srli_si128(right, 8));
+            auto average = _mm_srli_epi16(_mm_unpacklo_epi64(left, right), 2);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(destination + x), _mm_packus_epi16(average, average));
+        }
+        #endif
+
+        for(; x < destination_width; x++) {
+            auto &a = row0[x * 2];
+            auto &b = row0[x * 2 + 1];
+            auto &c = row1[x * 2];
+            auto &d = row1[x * 2 + 1];
+            auto &mc = destination[x];
+            mc.red = static_cast<std::uint8_t>((a.red + b.red + c.red + d.red) / 4);
+            mc.green = static_cast<std::uint8_t>((a.green + b.green + c.green + d.green) / 4);
+            mc.blue = static_cast<std::uint8_t>((a.blue + b.blue + c.blue + d.blue) / 4);
+            mc.alpha = static_cast<std::uint8_t>((a.alpha + b.alpha + c.alpha + d.alpha) / 4);
+        }
+    }
+
+    void generate_mipmap_chain(Invader::Pixel *chain, std::size_t width, std::size_t height, std::size_t depth, BitmapDataType type, std::size_t mipmap_count, bool gamma_correct) {
+        bool filter_depth = type == BitmapDataType::BITMAP_DATA_TYPE_3D_TEXTURE;
+        MipmapLevelSize source_size = { width, height, filter_depth ? depth : 1 };
+        auto *source = chain;
+
+        for(std::size_t m = 0; m < mipmap_count; m++) {
+            auto destination_size = next_level(source_size, type);
+            auto *destination = source + level_pixel_count(source_size, type);
+
+            // Each face/slice is its own image; for cube maps, faces are never blended together. Cube maps are stored
+            // level by level with all six faces in each level, as Invader's encode_bitmap() reads them (the bench's
+            // cube-map-layout checks hold us to that).
+            std::size_t image_count = filter_depth ? destination_size.depth : face_count(type);
+            std::size_t row_count = image_count * destination_size.height;
+            bool full_blocks = !gamma_correct && !filter_depth && source_size.width >= 2 && source_size.height >= 2;
+
+            static constexpr const std::size_t pixels_per_job = 65536;
+            std::size_t rows_per_job = std::max<std::size_t>(pixels_per_job / destination_size.width, 1);
+
+            LastResort::parallel_for((row_count + rows_per_job - 1) / rows_per_job, [&](std::size_t job) {
+                for(std::size_t r = job * rows_per_job; r < row_count && r < (job + 1) * rows_per_job; r++) {
+                    std::size_t z = r / destination_size.height;
+                    std::size_t y = r % destination_size.height;
+                    auto *destination_row = destination + r * destination_size.width;
+
+                    if(full_blocks) {
+                        const auto *row0 = source + (z * source_size.height + y * 2) * source_size.width;
+                        filter_row_2x2(row0, row0 + source_size.width, destination_row, destination_size.width);
+                    }
+                    else if(gamma_correct) {
+                        filter_row<true>(source, source_size, z, y, destination_row, destination_size.width, filter_depth);
+                    }
+                    else {
+                        filter_row<false>(source, source_size, z, y, destination_row, destination_size.width, filter_depth);
+                    }
+                }
+            });
+
+            source = destination;
+            source_size = destination_size;
+        }
+    }
+}
@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__MIPMAP_HPP
+#define LAST_RESORT__MIPMAP_HPP
+
+#include <cstddef>
+#include <invader/bitmap/pixel.hpp>
+#include <invader/tag/hek/header.hpp>
+
+namespace LastResort {
+    /**
+     * Get whether or not mipmaps can be generated for a bitmap of this type
+     * @param type  bitmap type
+     * @param depth depth of the bitmap
+     * @return      true if supported
+     */
+    bool can_generate_mipmaps(Invader::HEK::BitmapDataType type, std::size_t depth) noexcept;
+
+    /**
+     * Get the number of mipmaps (not counting the base level) needed to go all the way down to 1x1
+     * @param width  width of the base level
+     * @param height height of the base level
+     * @param depth  depth of the base level (only used for 3D textures)
+     * @param type   bitmap type
+     * @return       number of mipmaps
+     */
+    std::size_t full_mipmap_count(std::size_t width, std::size_t height, std::size_t depth, Invader::HEK::BitmapDataType type) noexcept;
+
+    /**
+     * Get the number of pixels in a mipmap chain, including every cube map face and 3D texture slice
+     * @param width         width of the base level
+     * @param height        height of the base level
+     * @param depth         depth of the base level (only used for 3D textures)
+     * @param type          bitmap type
+     * @param mipmap_count  number of mipmaps (not counting the base level)
+     * @return              number of pixels
+     */
+    std::size_t mipmap_chain_pixel_count(std::size_t width, std::size_t height, std::size_t depth, Invader::HEK::BitmapDataType type, std::size_t mipmap_count) noexcept;
+
+    /**
+     * Generate a mipmap chain in place with a box filter.
+     *
+     * Levels are stored one after another; each level holds all 6 cube map faces or all of its 3D texture slices. Each
+     * level is averaged from the one before it, 2x2 pixels at a time (2x2x2 for 3D textures), rounding down.
+     *
+     * @param chain         buffer with room for mipmap_chain_pixel_count() pixels with the base level already filled in
+     * @param width         width of the base level
+     * @param height        height of the base level
+     * @param depth         depth of the base level (only used for 3D textures)
+     * @param type          bitmap type
+     * @param mipmap_count  number of mipmaps (not counting the base level) to generate
+     * @param gamma_correct average color channels in linear space rather than gamma space
+     */
+    void generate_mipmap_chain(Invader::Pixel *chain, std::size_t width, std::size_t height, std::size_t depth, Invader::HEK::BitmapDataType type, std::size_t mipmap_count, bool gamma_correct);
+}
+
+#endif
@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <condition_variable>
+#include <vector>
+
+#include "parallel.hpp"
+
+namespace LastResort::Detail {
+    // Worker threads shared by every parallel_for() call, started as they are first needed
+    class WorkerPool {
+    public:
+        void run(ParallelLoop &loop) {
+            {
+                std::scoped_lock lock(this->mutex);
+                while(this->workers.size() < loop.max_helpers) {
+                    this->workers.emplace_back([this]() { this->work(); });
+                }
+                this->loops.emplace_back(&loop);
+            }
+            this->loop_available.notify_all();
+
+            loop.work();
+
+            // Stop any more workers from joining, then wait for the ones that did to finish their jobs
+            std::unique_lock lock(this->mutex);
+            this->loops.erase(std::find(this->loops.begin(), this->loops.end(), &loop));
+            this->loop_finished.wait(lock, [&loop]() { return loop.helpers == 0; });
+        }
+
+        static WorkerPool &shared() noexcept {
+            static WorkerPool pool;
+            return pool;
+        }
+
+        WorkerPool() = default;
+        WorkerPool(const WorkerPool &) = delete;
+        WorkerPool &operator=(const WorkerPool &) = delete;
+
+        ~WorkerPool() {
+            {
+                std::scoped_lock lock(this->mutex);
+                this->stopping = true;
+            }
+            this->loop_available.notify_all();
+            for(auto &w : this->workers) {
+                w.join();
+            }
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable loop_available;
+        std::condition_variable loop_finished;
+        std::vector<std::thread> workers;
+        std::vector<ParallelLoop *> loops; // in the order they were started
+        bool stopping = false;
+
+        // Newest loops first, as those are usually nested in older ones that are waiting on them
+        ParallelLoop *find_loop() noexcept {
+            for(auto i = this->loops.rbegin(); i != this->loops.rend(); i++) {
+                auto *loop = *i;
+                if(loop->helpers < loop->max_helpers && loop->next_job < loop->count) {
+                    return loop;
+                }
+            }
+            return nullptr;
+        }
+
+        void work() {
+            std::unique_lock lock(this->mutex);
+            while(true) {
+                ParallelLoop *loop = nullptr;
+                this->loop_available.wait(lock, [this, &loop]() { return this->stopping || (loop = this->find_loop()) != nullptr; });
+                if(this->stopping) {
+                    return;
+                }
+                loop->helpers++;
+                lock.unlock();
+
+                {
+                    StatsScope stats_scope(loop->stats);
+                    DiagnosticScope diagnostic_scope(loop->diagnostics);
+                    ThreadCountScope thread_count_scope(loop->thread_count_override);
+                    loop->work();
+                }
+
+                lock.lock();
+                if(--loop->helpers == 0) {
+                    this->loop_finished.notify_all();
+                }
+            }
+        }
+    };
+
+    void run_parallel_loop(ParallelLoop &loop) {
+        WorkerPool::shared().run(loop);
+    }
+}
@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__PARALLEL_HPP
+#define LAST_RESORT__PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "diagnostics.hpp"
+#include "stats.hpp"
+
+namespace LastResort {
+    namespace Detail {
+        inline std::atomic<std::size_t> thread_count = 0;
+        inline thread_local std::size_t thread_count_override = 0;
+    }
+
+    /**
+     * Set the maximum number of threads parallel_for() may use
+     * @param count number of threads (0 = use the hardware concurrency)
+     */
+    inline void set_thread_count(std::size_t count) noexcept {
+        Detail::thread_count = count;
+    }
+
+    /**
+     * Override the maximum number of threads parallel_for() may use on this thread until this goes out of scope
+     */
+    class ThreadCountScope {
+    public:
+        /**
+         * Start overriding the thread count
+         * @param count number of threads (0 = use the value from set_thread_count())
+         */
+        explicit ThreadCountScope(std::size_t count) noexcept : previous(Detail::thread_count_override) {
+            Detail::thread_count_override = count;
+        }
+
+        ~ThreadCountScope() {
+            Detail::thread_count_override = this->previous;
+        }
+
+        ThreadCountScope(const ThreadCountScope &) = delete;
+        ThreadCountScope &operator=(const ThreadCountScope &) = delete;
+
+    private:
+        std::size_t previous;
+    };
+
+    /**
+     * Get the maximum number of threads parallel_for() may use
+     * @return number of threads
+     */
+    inline std::size_t get_thread_count() noexcept {
+        std::size_t count = Detail::thread_count_override;
+        if(count == 0) {
+            count = Detail::thread_count;
+        }
+        if(count == 0) {
+            count = std::max(std::thread::hardware_concurrency(), 1U);
+        }
+        return count;
+    }
+
+    namespace Detail {
+        // One parallel_for() call that worker threads can help with
+        struct ParallelLoop {
+            std::size_t count;
+            std::atomic<std::size_t> next_job = 0;
+            void (*invoke)(const void *function, std::size_t job);
+            const void *function;
+
+            // Workers may only join while fewer than max_helpers are working on this loop (guarded by the pool mutex)
+            std::size_t helpers = 0;
+            std::size_t max_helpers;
+
+            // What the calling thread had set, so the workers' jobs (and any loops they start) see the same thing
+            ConversionStats *stats;
+            DiagnosticSink *diagnostics;
+            std::size_t thread_count_override;
+
+            std::mutex exception_mutex;
+            std::exception_ptr exception;
+
+            // Do jobs until there are none left to claim
+            void work() noexcept {
+                while(true) {
+                    std::size_t job = this->next_job++;
+                    if(job >= this->count) {
+                        break;
+                    }
+                    try {
+                        this->invoke(this->function, job);
+                    }
+                    catch(...) {
+                        std::scoped_lock lock(this->exception_mutex);
+                        if(!this->exception) {
+                            this->exception = std::current_exception();
+                        }
+                        this->next_job = this->count;
+                    }
+                }
+            }
+        };
+
+        /**
+         * Run a loop on the calling thread and on any worker threads in the shared pool that are free, returning once
+         * every job that was started has finished
+         * @param loop loop to run
+         */
+        void run_parallel_loop(ParallelLoop &loop);
+    }
+
+    /**
+     * Call function(i) for every i in [0, count), spread across worker threads.
+     *
+     * The worker threads are started once and shared by every call in the process. The calling thread does jobs too, and
+     * any worker that is free helps with the most recently started loop, so a loop started from inside another one's job
+     * (such as a big bitmap's strips while several tags are converted at once) is spread out as well. No more than
+     * get_thread_count() threads work on any one loop. The first exception thrown by a job is rethrown once every
+     * started job has finished; remaining jobs are skipped. Stats and diagnostics collected by the calling thread (see
+     * StatsScope and DiagnosticScope) are collected from the workers too, and ThreadCountScope applies to them as well.
+     *
+     * @param count    number of jobs
+     * @param function function to call for each job
+     */
+    template <typename F> void parallel_for(std::size_t count, const F &function) {
+        std::size_t threads = std::min(count, get_thread_count());
+        if(threads <= 1) {
+            for(std::size_t i = 0; i < count; i++) {
+                function(i);
+            }
+            return;
+        }
+
+        Detail::ParallelLoop loop;
+        loop.count = count;
+        loop.invoke = [](const void *function, std::size_t job) {
+            (*static_cast<const F *>(function))(job);
+        };
+        loop.function = &function;
+        loop.max_helpers = threads - 1;
+        loop.stats = Detail::current_stats;
+        loop.diagnostics = Detail::current_diagnostics;
+        loop.thread_count_override = Detail::thread_count_override;
+        Detail::run_parallel_loop(loop);
+
+        if(loop.exception) {
+            std::rethrow_exception(loop.exception);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include "pixel_stats.hpp"
+
+namespace LastResort {
+    void PixelStats::add(const Invader::Pixel *pixels, std::size_t count, bool luminance) noexcept {
+        // Accumulate with plain ORs and min/max so the loop vectorizes; the chunks passed in are already in cache
+        std::uint8_t min_alpha = this->min_alpha;
+        std::uint8_t max_alpha = this->max_alpha;
+        std::uint8_t partial_alpha = 0;
+        std::uint8_t color = 0;
+        for(std::size_t i = 0; i < count; i++) {
+            auto &pixel = pixels[i];
+            min_alpha = std::min(min_alpha, pixel.alpha);
+            max_alpha = std::max(max_alpha, pixel.alpha);
+            partial_alpha |= static_cast<std::uint8_t>(pixel.alpha != 0x00 && pixel.alpha != 0xFF);
+            color |= static_cast<std::uint8_t>((pixel.red ^ pixel.green) | (pixel.green ^ pixel.blue));
+        }
+
+        this->min_alpha = min_alpha;
+        this->max_alpha = max_alpha;
+        this->one_bit_alpha = this->one_bit_alpha && !partial_alpha;
+        this->greyscale = this->greyscale && !color;
+        this->pixel_count += count;
+
+        if(luminance) {
+            bool white = this->white;
+            bool alpha_equals_luminance = this->alpha_equals_luminance;
+            for(std::size_t i = 0; i < count && (white || alpha_equals_luminance); i++) {
+                auto y = pixels[i].convert_to_y8();
+                white = white && y == 0xFF;
+                alpha_equals_luminance = alpha_equals_luminance && y == pixels[i].alpha;
+            }
+            this->white = white;
+            this->alpha_equals_luminance = alpha_equals_luminance;
+        }
+    }
+
+    void PixelStats::merge(const PixelStats &other) noexcept {
+        this->pixel_count += other.pixel_count;
+        this->min_alpha = std::min(this->min_alpha, other.min_alpha);
+        this->max_alpha = std::max(this->max_alpha, other.max_alpha);
+        this->one_bit_alpha = this->one_bit_alpha && other.one_bit_alpha;
+        this->greyscale = this->greyscale && other.greyscale;
+        this->white = this->white && other.white;
+        this->alpha_equals_luminance = this->alpha_equals_luminance && other.alpha_equals_luminance;
+    }
+
+    bool format_class_needs_luminance(Invader::HEK::BitmapFormat format_class) noexcept {
+        return format_class == Invader::HEK::BitmapFormat::BITMAP_FORMAT_MONOCHROME;
+    }
+
+    Invader::HEK::BitmapDataFormat choose_bitmap_format(const PixelStats &stats, Invader::HEK::BitmapFormat format_class, std::string &reason) {
+        using namespace Invader::HEK;
+
+        bool alpha = stats.has_alpha();
+        switch(format_class) {
+            case BitmapFormat::BITMAP_FORMAT_COMPRESSED_WITH_COLOR_KEY_TRANSPARENCY:
+                reason = "color key transparency is always DXT1";
+                return BitmapDataFormat::BITMAP_DATA_FORMAT_DXT1;
+
+            case BitmapFormat::BITMAP_FORMAT_COMPRESSED_WITH_EXPLICIT_ALPHA:
+                reason = alpha ? "alpha is present" : "alpha is fully opaque";
+                return alpha ? BitmapDataFormat::BITMAP_DATA_FORMAT_DXT3 : BitmapDataFormat::BITMAP_DATA_FORMAT_DXT1;
+
+            case BitmapFormat::BITMAP_FORMAT_COMPRESSED_WITH_INTERPOLATED_ALPHA:
+                reason = alpha ? "alpha is present" : "alpha is fully opaque";
+                return alpha ? BitmapDataFormat::BITMAP_DATA_FORMAT_DXT5 : BitmapDataFormat::BITMAP_DATA_FORMAT_DXT1;
+
+            case BitmapFormat::BITMAP_FORMAT_16_BIT_COLOR:
+                if(!alpha) {
+                    reason = "alpha is fully opaque";
+                    return BitmapDataFormat::BITMAP_DATA_FORMAT_R5G6B5;
+                }
+                else if(stats.one_bit_alpha) {
+                    reason = "alpha is only ever 0 or 255";
+                    return BitmapDataFormat::BITMAP_DATA_FORMAT_A1R5G5B5;
+                }
+                else {
+                    reason = "alpha ranges from " + std::to_string(stats.min_alpha) + " to " + std::to_string(stats.max_alpha);
+                    return BitmapDataFormat::BITMAP_DATA_FORMAT_A4R4G4B4;
+                }
+
+            case BitmapFormat::BITMAP_FORMAT_32_BIT_COLOR:
+                reason = alpha ? "alpha is present" : "alpha is fully opaque";
+                return alpha ? BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8 : BitmapDataFormat::BITMAP_DATA_FORMAT_X8R8G8B8;
+
+            case BitmapFormat::BITMAP_FORMAT_MONOCHROME: {
+                BitmapDataFormat format;
+                if(!alpha) {
+                    reason = "alpha is fully opaque";
+                    format = BitmapDataFormat::BITMAP_DATA_FORMAT_Y8;
+                }
+                else if(stats.white) {
+                    reason = "alpha is present and luminance is always white";
+                    format = BitmapDataFormat::BITMAP_DATA_FORMAT_A8;
+                }
+                else if(stats.alpha_equals_luminance) {
+                    reason = "alpha is equal to luminance";
+                    format = BitmapDataFormat::BITMAP_DATA_FORMAT_AY8;
+                }
+                else {
+                    reason = "alpha and luminance both vary independently";
+                    format = BitmapDataFormat::BITMAP_DATA_FORMAT_A8Y8;
+                }
+                if(!stats.greyscale) {
+                    reason += "; color is discarded";
+                }
+                return format;
+            }
+
+            default:
+                reason = "unknown format class; keeping 32-bit color";
+                return BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8;
+        }
+    }
+}
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__PIXEL_STATS_HPP
+#define LAST_RESORT__PIXEL_STATS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <invader/bitmap/pixel.hpp>
+#include <invader/tag/hek/definition.hpp>
+
+namespace LastResort {
+    /**
+     * What the pixels of a bitmap look like, as far as choosing a format is concerned
+     */
+    struct PixelStats {
+        /** Number of pixels looked at */
+        std::size_t pixel_count = 0;
+
+        /** Lowest alpha value */
+        std::uint8_t min_alpha = 0xFF;
+
+        /** Highest alpha value */
+        std::uint8_t max_alpha = 0x00;
+
+        /** Every alpha value is either 0x00 or 0xFF */
+        bool one_bit_alpha = true;
+
+        /** Red, green, and blue are equal in every pixel */
+        bool greyscale = true;
+
+        /** Every pixel's luminance is 0xFF (only gathered if luminance is requested) */
+        bool white = true;
+
+        /** Every pixel's alpha is equal to its luminance (only gathered if luminance is requested) */
+        bool alpha_equals_luminance = true;
+
+        /**
+         * Get whether any pixel is not fully opaque
+         * @return true if alpha is present
+         */
+        bool has_alpha() const noexcept {
+            return this->min_alpha != 0xFF;
+        }
+
+        /**
+         * Look at more pixels
+         * @param pixels    pixels
+         * @param count     number of pixels
+         * @param luminance also gather luminance stats, which costs a bit more
+         */
+        void add(const Invader::Pixel *pixels, std::size_t count, bool luminance) noexcept;
+
+        /**
+         * Combine with stats gathered from other pixels
+         * @param other other stats
+         */
+        void merge(const PixelStats &other) noexcept;
+    };
+
+    /**
+     * Check if a format class needs luminance stats to choose a format
+     * @param format_class format class
+     * @return             true if luminance is needed
+     */
+    bool format_class_needs_luminance(Invader::HEK::BitmapFormat format_class) noexcept;
+
+    /**
+     * Choose the smallest format in a format class that holds the pixels without losing anything the class can keep.
+     * This makes the same choices as Invader's most_efficient_format(), but from stats that were already gathered.
+     * @param stats        stats of the pixels to encode
+     * @param format_class format class
+     * @param reason       set to a short explanation of the choice
+     * @return             format
+     */
+    Invader::HEK::BitmapDataFormat choose_bitmap_format(const PixelStats &stats, Invader::HEK::BitmapFormat format_class, std::string &reason);
+}
+
+#endif
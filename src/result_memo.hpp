@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__RESULT_MEMO_HPP
+#define LAST_RESORT__RESULT_MEMO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+
+#include "hash.hpp"
+
+namespace LastResort {
+    /**
+     * Identifies a conversion of some data: a 128-bit hash of the input and everything else that affects the output
+     */
+    struct MemoKey {
+        std::uint64_t hash[2] = { 0x6C6173742D726573ULL, 0x6F72742D6D656D6FULL };
+
+        /**
+         * Add some bytes to the key
+         * @param data data to add
+         * @param size size of the data in bytes
+         */
+        void add(const void *data, std::size_t size) noexcept {
+            this->hash[0] = hash_bytes(data, size, this->hash[0]);
+            this->hash[1] = hash_bytes(data, size, this->hash[1]);
+        }
+
+        /**
+         * Add a value to the key
+         * @param value value to add
+         */
+        template <typename T> void add_value(const T &value) noexcept {
+            static_assert(std::is_scalar_v<T>, "only scalars can be added as values, as padding would be hashed otherwise");
+            this->add(&value, sizeof(value));
+        }
+
+        bool operator==(const MemoKey &other) const noexcept {
+            return this->hash[0] == other.hash[0] && this->hash[1] == other.hash[1];
+        }
+    };
+
+    /**
+     * Remembers the results of conversions so identical data converted again in the same process (such as a bitmap
+     * copied into several tags) can reuse them. The least recently used results are forgotten first once the results
+     * take up too much memory. This can be used from several threads at once.
+     */
+    template <typename T> class ResultMemo {
+    public:
+        /**
+         * Find a result
+         * @param key key
+         * @return    result, or null if there is none
+         */
+        std::shared_ptr<const T> find(const MemoKey &key) {
+            std::scoped_lock lock(this->mutex);
+            auto entry = this->index.find(key);
+            if(entry == this->index.end()) {
+                return nullptr;
+            }
+            this->entries.splice(this->entries.begin(), this->entries, entry->second);
+            return entry->second->result;
+        }
+
+        /**
+         * Remember a result, unless it is too big to ever fit or is already remembered
+         * @param key         key
+         * @param size        approximate size of the result in bytes
+         * @param make_result called to make the result to keep, only if it will be kept
+         */
+        template <typename F> void store(const MemoKey &key, std::size_t size, const F &make_result) {
+            if(size > this->max_bytes) {
+                return;
+            }
+
+            // Don't bother making a copy that won't be kept
+            {
+                std::scoped_lock lock(this->mutex);
+                if(this->index.find(key) != this->index.end()) {
+                    return;
+                }
+            }
+            auto shared_result = std::make_shared<const T>(make_result());
+
+            std::scoped_lock lock(this->mutex);
+
+            // Another thread may have gotten here first with the same result
+            if(this->index.find(key) != this->index.end()) {
+                return;
+            }
+
+            while(!this->entries.empty() && this->bytes + size > this->max_bytes) {
+                auto &oldest = this->entries.back();
+                this->bytes -= oldest.size;
+                this->index.erase(oldest.key);
+                this->entries.pop_back();
+            }
+
+            this->entries.push_front(Entry { key, std::move(shared_result), size });
+            this->index.emplace(key, this->entries.begin());
+            this->bytes += size;
+        }
+
+        /**
+         * Forget every result
+         */
+        void clear() noexcept {
+            std::scoped_lock lock(this->mutex);
+            this->index.clear();
+            this->entries.clear();
+            this->bytes = 0;
+        }
+
+        /**
+         * Instantiate a memo
+         * @param max_bytes maximum total size of the results kept
+         */
+        explicit ResultMemo(std::size_t max_bytes) noexcept : max_bytes(max_bytes) {}
+
+        ResultMemo(const ResultMemo &) = delete;
+        ResultMemo &operator=(const ResultMemo &) = delete;
+
+    private:
+        struct Entry {
+            MemoKey key;
+            std::shared_ptr<const T> result;
+            std::size_t size;
+        };
+
+        struct KeyHash {
+            std::size_t operator()(const MemoKey &key) const noexcept {
+                return static_cast<std::size_t>(key.hash[0]);
+            }
+        };
+
+        std::mutex mutex;
+        std::list<Entry> entries; // most recently used first
+        std::unordered_map<MemoKey, typename std::list<Entry>::iterator, KeyHash> index;
+        std::size_t bytes = 0;
+        std::size_t max_bytes;
+    };
+}
+
+#endif
@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <invader/tag/hek/header.hpp>
+#include "scan.hpp"
+
+namespace LastResort {
+    // Reads big endian values out of a tag file, checking bounds as it goes
+    class TagFileReader {
+    public:
+        TagFileReader(const std::byte *data, std::size_t size) noexcept : data(data), size(size) {}
+
+        bool has(std::size_t offset, std::size_t length) const noexcept {
+            return offset <= this->size && length <= this->size - offset;
+        }
+
+        std::uint16_t read_u16(std::size_t offset) const noexcept {
+            auto *bytes = reinterpret_cast<const std::uint8_t *>(this->data + offset);
+            return static_cast<std::uint16_t>((bytes[0] << 8) | bytes[1]);
+        }
+
+        std::uint32_t read_u32(std::size_t offset) const noexcept {
+            auto *bytes = reinterpret_cast<const std::uint8_t *>(this->data + offset);
+            return (static_cast<std::uint32_t>(bytes[0]) << 24) | (static_cast<std::uint32_t>(bytes[1]) << 16) | (static_cast<std::uint32_t>(bytes[2]) << 8) | bytes[3];
+        }
+
+    private:
+        const std::byte *data;
+        std::size_t size;
+    };
+
+    // HEK layouts of the few structs we look at. Everything after a struct is its child data, in member order.
+    static constexpr const std::size_t REFLEXIVE_SIZE = 0xC;
+
+    static constexpr const std::size_t SOUND_SIZE = 0xA4;
+    static constexpr const std::size_t SOUND_FLAGS = 0x00;
+    static constexpr const std::size_t SOUND_CHANNEL_COUNT = 0x6C;
+    static constexpr const std::size_t SOUND_FORMAT = 0x6E;
+    static constexpr const std::size_t SOUND_PROMOTION_SOUND = 0x70;
+    static constexpr const std::size_t SOUND_PITCH_RANGES = 0x98;
+
+    static constexpr const std::size_t DEPENDENCY_PATH_SIZE = 0x08;
+
+    static constexpr const std::size_t SOUND_PITCH_RANGE_SIZE = 0x48;
+    static constexpr const std::size_t SOUND_PITCH_RANGE_ACTUAL_PERMUTATION_COUNT = 0x2C;
+    static constexpr const std::size_t SOUND_PITCH_RANGE_PERMUTATIONS = 0x3C;
+
+    static constexpr const std::size_t SOUND_PERMUTATION_SIZE = 0x7C;
+    static constexpr const std::size_t SOUND_PERMUTATION_FORMAT = 0x28;
+    static constexpr const std::size_t SOUND_PERMUTATION_SAMPLES_SIZE = 0x40;
+    static constexpr const std::size_t SOUND_PERMUTATION_MOUTH_DATA_SIZE = 0x54;
+    static constexpr const std::size_t SOUND_PERMUTATION_SUBTITLE_DATA_SIZE = 0x68;
+
+    static constexpr const std::uint32_t SOUND_FLAGS_SPLIT_LONG_SOUND_INTO_PERMUTATIONS = 1 << 1;
+
+    static constexpr const std::size_t BITMAP_SIZE = 0x6C;
+    static constexpr const std::size_t BITMAP_COMPRESSED_COLOR_PLATE_DATA_SIZE = 0x1C;
+    static constexpr const std::size_t BITMAP_PROCESSED_PIXEL_DATA_SIZE = 0x30;
+    static constexpr const std::size_t BITMAP_BITMAP_GROUP_SEQUENCE = 0x54;
+    static constexpr const std::size_t BITMAP_BITMAP_DATA = 0x60;
+
+    static constexpr const std::size_t BITMAP_GROUP_SEQUENCE_SIZE = 0x40;
+    static constexpr const std::size_t BITMAP_GROUP_SEQUENCE_SPRITES = 0x34;
+    static constexpr const std::size_t BITMAP_GROUP_SPRITE_SIZE = 0x20;
+
+    static constexpr const std::size_t BITMAP_DATA_SIZE = 0x30;
+    static constexpr const std::size_t BITMAP_DATA_WIDTH = 0x04;
+    static constexpr const std::size_t BITMAP_DATA_HEIGHT = 0x06;
+    static constexpr const std::size_t BITMAP_DATA_DEPTH = 0x08;
+    static constexpr const std::size_t BITMAP_DATA_TYPE = 0x0A;
+    static constexpr const std::size_t BITMAP_DATA_FORMAT = 0x0C;
+    static constexpr const std::size_t BITMAP_DATA_FLAGS = 0x0E;
+    static constexpr const std::size_t BITMAP_DATA_MIPMAP_COUNT = 0x14;
+
+    static bool scan_sound(const TagFileReader &reader, std::size_t offset, TagScan &scan) {
+        if(!reader.has(offset, SOUND_SIZE)) {
+            return false;
+        }
+        auto &sound = scan.sound.emplace();
+        sound.flags = reader.read_u32(offset + SOUND_FLAGS);
+        sound.channel_count = static_cast<Invader::HEK::SoundChannelCount>(reader.read_u16(offset + SOUND_CHANNEL_COUNT));
+        sound.format = static_cast<Invader::HEK::SoundFormat>(reader.read_u16(offset + SOUND_FORMAT));
+
+        // The format that matters is each permutation's, so skip the promotion sound's path to get to the pitch ranges
+        std::size_t child_offset = offset + SOUND_SIZE;
+        std::size_t promotion_path_size = reader.read_u32(offset + SOUND_PROMOTION_SOUND + DEPENDENCY_PATH_SIZE);
+        if(promotion_path_size > 0) {
+            child_offset += promotion_path_size + 1;
+        }
+
+        std::size_t pitch_range_count = reader.read_u32(offset + SOUND_PITCH_RANGES);
+        if(!reader.has(child_offset, pitch_range_count * SOUND_PITCH_RANGE_SIZE)) {
+            return false;
+        }
+        bool split = sound.flags & SOUND_FLAGS_SPLIT_LONG_SOUND_INTO_PERMUTATIONS;
+        std::size_t permutations_offset = child_offset + pitch_range_count * SOUND_PITCH_RANGE_SIZE;
+        for(std::size_t p = 0; p < pitch_range_count; p++) {
+            std::size_t pitch_range_offset = child_offset + p * SOUND_PITCH_RANGE_SIZE;
+            std::size_t permutation_count = reader.read_u32(pitch_range_offset + SOUND_PITCH_RANGE_PERMUTATIONS);
+            if(!reader.has(permutations_offset, permutation_count * SOUND_PERMUTATION_SIZE)) {
+                return false;
+            }
+
+            // Only the real permutations count, as the ones they were split into are converted along with them
+            std::size_t real_permutation_count = split ? std::min<std::size_t>(reader.read_u16(pitch_range_offset + SOUND_PITCH_RANGE_ACTUAL_PERMUTATION_COUNT), permutation_count) : permutation_count;
+
+            // Each permutation's sample, mouth, and subtitle data follows the permutations
+            std::size_t data_offset = permutations_offset + permutation_count * SOUND_PERMUTATION_SIZE;
+            for(std::size_t j = 0; j < permutation_count; j++) {
+                std::size_t permutation_offset = permutations_offset + j * SOUND_PERMUTATION_SIZE;
+                if(j < real_permutation_count && static_cast<Invader::HEK::SoundFormat>(reader.read_u16(permutation_offset + SOUND_PERMUTATION_FORMAT)) != Invader::HEK::SoundFormat::SOUND_FORMAT_XBOX_ADPCM) {
+                    sound.permutations_to_convert++;
+                }
+                std::size_t data_size = static_cast<std::size_t>(reader.read_u32(permutation_offset + SOUND_PERMUTATION_SAMPLES_SIZE)) + reader.read_u32(permutation_offset + SOUND_PERMUTATION_MOUTH_DATA_SIZE) + reader.read_u32(permutation_offset + SOUND_PERMUTATION_SUBTITLE_DATA_SIZE);
+                if(!reader.has(data_offset, data_size)) {
+                    return false;
+                }
+                data_offset += data_size;
+            }
+            permutations_offset = data_offset;
+        }
+
+        return true;
+    }
+
+    static bool scan_bitmap(const TagFileReader &reader, std::size_t offset, TagScan &scan) {
+        if(!reader.has(offset, BITMAP_SIZE)) {
+            return false;
+        }
+
+        // Skip the color plate and pixel data, then the sequences and their sprites, to get to the bitmap data
+        std::size_t child_offset = offset + BITMAP_SIZE;
+        child_offset += reader.read_u32(offset + BITMAP_COMPRESSED_COLOR_PLATE_DATA_SIZE);
+        child_offset += reader.read_u32(offset + BITMAP_PROCESSED_PIXEL_DATA_SIZE);
+
+        std::size_t sequence_count = reader.read_u32(offset + BITMAP_BITMAP_GROUP_SEQUENCE);
+        if(!reader.has(child_offset, sequence_count * BITMAP_GROUP_SEQUENCE_SIZE)) {
+            return false;
+        }
+        std::size_t sprites_offset = child_offset + sequence_count * BITMAP_GROUP_SEQUENCE_SIZE;
+        for(std::size_t s = 0; s < sequence_count; s++) {
+            std::size_t sprite_count = reader.read_u32(child_offset + s * BITMAP_GROUP_SEQUENCE_SIZE + BITMAP_GROUP_SEQUENCE_SPRITES);
+            if(!reader.has(sprites_offset, sprite_count * BITMAP_GROUP_SPRITE_SIZE)) {
+                return false;
+            }
+            sprites_offset += sprite_count * BITMAP_GROUP_SPRITE_SIZE;
+        }
+        child_offset = sprites_offset;
+
+        std::size_t bitmap_data_count = reader.read_u32(offset + BITMAP_BITMAP_DATA);
+        if(!reader.has(child_offset, bitmap_data_count * BITMAP_DATA_SIZE)) {
+            return false;
+        }
+        scan.bitmap_data.reserve(bitmap_data_count);
+        for(std::size_t b = 0; b < bitmap_data_count; b++) {
+            std::size_t data_offset = child_offset + b * BITMAP_DATA_SIZE;
+            auto &data = scan.bitmap_data.emplace_back();
+            data.width = reader.read_u16(data_offset + BITMAP_DATA_WIDTH);
+            data.height = reader.read_u16(data_offset + BITMAP_DATA_HEIGHT);
+            data.depth = reader.read_u16(data_offset + BITMAP_DATA_DEPTH);
+            data.type = static_cast<Invader::HEK::BitmapDataType>(reader.read_u16(data_offset + BITMAP_DATA_TYPE));
+            data.format = static_cast<Invader::HEK::BitmapDataFormat>(reader.read_u16(data_offset + BITMAP_DATA_FORMAT));
+            data.flags = reader.read_u16(data_offset + BITMAP_DATA_FLAGS);
+            data.mipmap_count = reader.read_u16(data_offset + BITMAP_DATA_MIPMAP_COUNT);
+        }
+
+        return true;
+    }
+
+    std::optional<TagScan> scan_tag(const std::byte *data, std::size_t size) {
+        if(size < sizeof(Invader::HEK::TagFileHeader)) {
+            return std::nullopt;
+        }
+
+        TagScan scan;
+        scan.tag_fourcc = reinterpret_cast<const Invader::HEK::TagFileHeader *>(data)->tag_fourcc;
+
+        TagFileReader reader(data, size);
+        bool valid;
+        switch(scan.tag_fourcc) {
+            case Invader::HEK::TagFourCC::TAG_FOURCC_BITMAP:
+                valid = scan_bitmap(reader, sizeof(Invader::HEK::TagFileHeader), scan);
+                break;
+            case Invader::HEK::TagFourCC::TAG_FOURCC_SOUND:
+                valid = scan_sound(reader, sizeof(Invader::HEK::TagFileHeader), scan);
+                break;
+            default:
+                valid = true;
+                break;
+        }
+
+        if(!valid) {
+            return std::nullopt;
+        }
+        return scan;
+    }
+}
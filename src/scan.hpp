@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__SCAN_HPP
+#define LAST_RESORT__SCAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include <invader/tag/hek/definition.hpp>
+
+namespace LastResort {
+    struct BitmapDataScan {
+        std::uint16_t width;
+        std::uint16_t height;
+        std::uint16_t depth;
+        Invader::HEK::BitmapDataType type;
+        Invader::HEK::BitmapDataFormat format;
+        std::uint16_t flags;
+        std::uint16_t mipmap_count;
+    };
+
+    struct SoundScan {
+        std::uint32_t flags;
+        Invader::HEK::SoundChannelCount channel_count;
+        Invader::HEK::SoundFormat format;
+        std::size_t permutations_to_convert = 0; // permutations (not counting the ones they were split into) that aren't Xbox ADPCM
+    };
+
+    struct TagScan {
+        /** Tag class from the tag file header */
+        Invader::HEK::TagFourCC tag_fourcc;
+
+        /** Every bitmap data, if this is a bitmap tag */
+        std::vector<BitmapDataScan> bitmap_data;
+
+        /** Sound fields, if this is a sound tag */
+        std::optional<SoundScan> sound;
+    };
+
+    /**
+     * Read the fields of a tag that decide whether it needs converting, without parsing the rest of it. Pixel and
+     * sample data is skipped over, never read.
+     * @param data tag file data
+     * @param size size of the tag file data
+     * @return     scan, or std::nullopt if the tag is invalid or truncated
+     */
+    std::optional<TagScan> scan_tag(const std::byte *data, std::size_t size);
+}
+
+#endif
@@ -0,0 +1,167 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vorbis/vorbisfile.h>
+#include "buffer_pool.hpp"
+#include "error.hpp"
+#include "sound_stream.hpp"
+#include "stats.hpp"
+
+namespace LastResort {
+    // libvorbisfile callbacks for reading an Ogg Vorbis file already in memory
+    struct OggMemoryReader {
+        const std::byte *data;
+        std::size_t size;
+        std::size_t offset;
+    };
+
+    static std::size_t ogg_memory_read(void *ptr, std::size_t size, std::size_t nmemb, void *datasource) {
+        auto &reader = *reinterpret_cast<OggMemoryReader *>(datasource);
+        std::size_t bytes = std::min(size * nmemb, reader.size - reader.offset);
+        std::memcpy(ptr, reader.data + reader.offset, bytes);
+        reader.offset += bytes;
+        return size == 0 ? 0 : bytes / size;
+    }
+
+    static int ogg_memory_seek(void *datasource, ogg_int64_t offset, int whence) {
+        auto &reader = *reinterpret_cast<OggMemoryReader *>(datasource);
+        ogg_int64_t base;
+        switch(whence) {
+            case SEEK_SET:
+                base = 0;
+                break;
+            case SEEK_CUR:
+                base = static_cast<ogg_int64_t>(reader.offset);
+                break;
+            case SEEK_END:
+                base = static_cast<ogg_int64_t>(reader.size);
+                break;
+            default:
+                return -1;
+        }
+        if(base + offset < 0 || base + offset > static_cast<ogg_int64_t>(reader.size)) {
+            return -1;
+        }
+        reader.offset = static_cast<std::size_t>(base + offset);
+        return 0;
+    }
+
+    static long ogg_memory_tell(void *datasource) {
+        return static_cast<long>(reinterpret_cast<OggMemoryReader *>(datasource)->offset);
+    }
+
+    void decode_pcm_chunks(Invader::HEK::SoundFormat format, const std::byte *data, std::size_t size, std::size_t channel_count, std::size_t frames_per_chunk, const std::function<void (const std::vector<std::byte> &pcm)> &callback) {
+        std::size_t bytes_per_chunk = frames_per_chunk * channel_count * sizeof(std::int16_t);
+        auto chunk = BufferPool::shared().acquire(bytes_per_chunk);
+
+        switch(format) {
+            // Swap each chunk to little endian
+            case Invader::HEK::SoundFormat::SOUND_FORMAT_16_BIT_PCM: {
+                std::size_t usable_size = size - size % (channel_count * sizeof(std::int16_t));
+                for(std::size_t offset = 0; offset < usable_size; offset += bytes_per_chunk) {
+                    std::size_t chunk_size = std::min(bytes_per_chunk, usable_size - offset);
+                    StageTimer timer(Stage::STAGE_SOUND_DECODE, chunk_size, 0, chunk_size / (channel_count * sizeof(std::int16_t)));
+                    chunk.resize(chunk_size);
+                    for(std::size_t b = 0; b < chunk_size; b += 2) {
+                        chunk[b] = data[offset + b + 1];
+                        chunk[b + 1] = data[offset + b];
+                    }
+                    timer.finish();
+                    callback(chunk);
+                }
+                BufferPool::shared().release(std::move(chunk));
+                break;
+            }
+
+            // Decode a bit at a time and hand off whole chunks
+            case Invader::HEK::SoundFormat::SOUND_FORMAT_OGG_VORBIS: {
+                OggMemoryReader reader = { data, size, 0 };
+                ov_callbacks callbacks = { ogg_memory_read, ogg_memory_seek, nullptr, ogg_memory_tell };
+                OggVorbis_File vorbis_file;
+                if(ov_open_callbacks(&reader, &vorbis_file, nullptr, 0, callbacks) != 0) {
+                    throw DecodeError("Failed to open Ogg Vorbis data");
+                }
+
+                try {
+                    char buffer[4096];
+                    int bitstream;
+                    while(true) {
+                        StageTimer timer(Stage::STAGE_SOUND_DECODE);
+                        long bytes_read = ov_read(&vorbis_file, buffer, sizeof(buffer), 0, 2, 1, &bitstream);
+                        if(bytes_read > 0) {
+                            timer.count(static_cast<std::uint64_t>(bytes_read), 0, static_cast<std::uint64_t>(bytes_read) / (channel_count * sizeof(std::int16_t)));
+                        }
+                        timer.finish();
+                        if(bytes_read == 0) {
+                            break;
+                        }
+                        else if(bytes_read == OV_HOLE) {
+                            continue;
+                        }
+                        else if(bytes_read < 0) {
+                            throw DecodeError("Failed to decode Ogg Vorbis data");
+                        }
+
+                        auto *bytes = reinterpret_cast<const std::byte *>(buffer);
+                        while(bytes_read > 0) {
+                            std::size_t copy = std::min(static_cast<std::size_t>(bytes_read), bytes_per_chunk - chunk.size());
+                            chunk.insert(chunk.end(), bytes, bytes + copy);
+                            bytes += copy;
+                            bytes_read -= static_cast<long>(copy);
+                            if(chunk.size() == bytes_per_chunk) {
+                                callback(chunk);
+                                chunk.clear();
+                            }
+                        }
+                    }
+
+                    if(!chunk.empty()) {
+                        callback(chunk);
+                    }
+                }
+                catch(...) {
+                    ov_clear(&vorbis_file);
+                    throw;
+                }
+
+                ov_clear(&vorbis_file);
+                BufferPool::shared().release(std::move(chunk));
+                break;
+            }
+
+            default:
+                throw UnsupportedFormatError("Unknown format");
+        }
+    }
+
+    void SplitSampleWriter::write(const std::byte *data, std::size_t size) {
+        while(size > 0) {
+            if(this->slices.empty() || this->slices.back().size() == this->max_slice_size) {
+                std::size_t expected_remaining = this->expected_size > this->written ? this->expected_size - this->written : 0;
+                this->slices.emplace_back(BufferPool::shared().acquire(std::min(this->max_slice_size, std::max(size, expected_remaining))));
+            }
+
+            auto &slice = this->slices.back();
+            std::size_t copy = std::min(size, this->max_slice_size - slice.size());
+            slice.insert(slice.end(), data, data + copy);
+            data += copy;
+            size -= copy;
+            this->written += copy;
+        }
+    }
+
+    void SplitSampleWriter::write(std::vector<std::byte> &&data) {
+        bool at_slice_boundary = this->slices.empty() || this->slices.back().size() == this->max_slice_size;
+        if(at_slice_boundary && !data.empty() && data.size() <= this->max_slice_size) {
+            this->written += data.size();
+            this->slices.emplace_back(std::move(data));
+        }
+        else {
+            this->write(data.data(), data.size());
+            BufferPool::shared().release(std::move(data));
+        }
+        data.clear();
+    }
+}
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__SOUND_STREAM_HPP
+#define LAST_RESORT__SOUND_STREAM_HPP
+
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <vector>
+#include <invader/tag/hek/header.hpp>
+
+namespace LastResort {
+    /**
+     * Number of frames decoded at a time when streaming. This is a multiple of 64, the number of frames in an Xbox ADPCM
+     * block (36 bytes per channel), so chunks always end on a block boundary and only the last chunk of a permutation is
+     * ever padded.
+     */
+    static constexpr const std::size_t PCM_FRAMES_PER_CHUNK = 4160 * 64;
+
+    /**
+     * Decode 16-bit PCM or Ogg Vorbis sample data into 16-bit little endian PCM a chunk at a time
+     * @param format           format of the samples
+     * @param data             sample data
+     * @param size             size of the sample data in bytes
+     * @param channel_count    number of channels
+     * @param frames_per_chunk number of frames per chunk; only the last chunk can be shorter
+     * @param callback         called with each chunk of PCM
+     */
+    void decode_pcm_chunks(Invader::HEK::SoundFormat format, const std::byte *data, std::size_t size, std::size_t channel_count, std::size_t frames_per_chunk, const std::function<void (const std::vector<std::byte> &pcm)> &callback);
+
+    /**
+     * Collects sample data into slices no bigger than a given size, as split permutations need
+     */
+    class SplitSampleWriter {
+    public:
+        /**
+         * Write samples
+         * @param data samples to write
+         * @param size size of the samples in bytes
+         */
+        void write(const std::byte *data, std::size_t size);
+
+        /**
+         * Write samples, taking the buffer as a slice instead of copying it if it lines up with one
+         * @param data samples to write
+         */
+        void write(std::vector<std::byte> &&data);
+
+        /**
+         * Get the slices written so far
+         * @return slices
+         */
+        std::vector<std::vector<std::byte>> &get_slices() noexcept {
+            return this->slices;
+        }
+
+        /**
+         * Instantiate a writer
+         * @param max_slice_size maximum size of a slice in bytes
+         * @param expected_size  how many bytes are expected to be written in total, so slices can be allocated once (0 = unknown)
+         */
+        SplitSampleWriter(std::size_t max_slice_size = std::numeric_limits<std::size_t>::max(), std::size_t expected_size = 0) : max_slice_size(max_slice_size), expected_size(expected_size) {}
+
+    private:
+        std::size_t max_slice_size;
+        std::size_t expected_size;
+        std::size_t written = 0;
+        std::vector<std::vector<std::byte>> slices;
+    };
+}
+
+#endif
@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cinttypes>
+#include "stats.hpp"
+
+namespace LastResort {
+    const char *stage_name(Stage stage) noexcept {
+        switch(stage) {
+            case Stage::STAGE_READ:
+                return "read";
+            case Stage::STAGE_CACHE:
+                return "cache";
+            case Stage::STAGE_PARSE:
+                return "parse";
+            case Stage::STAGE_BITMAP_DECODE:
+                return "bitmap-decode";
+            case Stage::STAGE_FORMAT_SELECTION:
+                return "format-selection";
+            case Stage::STAGE_SWIZZLE:
+                return "swizzle";
+            case Stage::STAGE_DXT_SHUFFLE:
+                return "dxt-shuffle";
+            case Stage::STAGE_MIPMAPS:
+                return "mipmaps";
+            case Stage::STAGE_BITMAP_ENCODE:
+                return "bitmap-encode";
+            case Stage::STAGE_SOUND_DECODE:
+                return "sound-decode";
+            case Stage::STAGE_ADPCM_ENCODE:
+                return "adpcm-encode";
+            case Stage::STAGE_REUSE:
+                return "reuse";
+            case Stage::STAGE_GENERATE:
+                return "generate";
+            case Stage::STAGE_WRITE:
+                return "write";
+            default:
+                return "unknown";
+        }
+    }
+
+    void ConversionStats::add(Stage stage, std::uint64_t nanoseconds, std::uint64_t bytes, std::uint64_t pixels, std::uint64_t samples) noexcept {
+        auto &s = this->stages[stage];
+        s.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+        s.calls.fetch_add(1, std::memory_order_relaxed);
+        s.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        s.pixels.fetch_add(pixels, std::memory_order_relaxed);
+        s.samples.fetch_add(samples, std::memory_order_relaxed);
+    }
+
+    void ConversionStats::merge(const ConversionStats &other) noexcept {
+        for(std::size_t s = 0; s < Stage::STAGE_COUNT; s++) {
+            auto &from = other.stages[s];
+            auto &to = this->stages[s];
+            to.nanoseconds.fetch_add(from.nanoseconds, std::memory_order_relaxed);
+            to.calls.fetch_add(from.calls, std::memory_order_relaxed);
+            to.bytes.fetch_add(from.bytes, std::memory_order_relaxed);
+            to.pixels.fetch_add(from.pixels, std::memory_order_relaxed);
+            to.samples.fetch_add(from.samples, std::memory_order_relaxed);
+        }
+    }
+
+    void ConversionStats::print_text(std::FILE *file, const char *heading) const {
+        std::fprintf(file, "%s\n", heading);
+        std::fprintf(file, "  %-18s %12s %8s %14s %12s %12s\n", "stage", "time (ms)", "calls", "bytes", "pixels", "samples");
+        for(std::size_t s = 0; s < Stage::STAGE_COUNT; s++) {
+            auto &stage = this->stages[s];
+            if(stage.calls == 0) {
+                continue;
+            }
+            std::fprintf(file, "  %-18s %12.3f %8" PRIu64 " %14" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n", stage_name(static_cast<Stage>(s)), stage.nanoseconds / 1000000.0, stage.calls.load(), stage.bytes.load(), stage.pixels.load(), stage.samples.load());
+        }
+    }
+
+    void ConversionStats::print_json(std::FILE *file) const {
+        std::fprintf(file, "{");
+        const char *separator = "";
+        for(std::size_t s = 0; s < Stage::STAGE_COUNT; s++) {
+            auto &stage = this->stages[s];
+            if(stage.calls == 0) {
+                continue;
+            }
+            std::fprintf(file, "%s\"%s\": { \"seconds\": %.6f, \"calls\": %" PRIu64 ", \"bytes\": %" PRIu64 ", \"pixels\": %" PRIu64 ", \"samples\": %" PRIu64 " }", separator, stage_name(static_cast<Stage>(s)), stage.nanoseconds / 1000000000.0, stage.calls.load(), stage.bytes.load(), stage.pixels.load(), stage.samples.load());
+            separator = ", ";
+        }
+        std::fprintf(file, "}");
+    }
+
+    std::string json_escape(const std::string &string) {
+        std::string escaped;
+        escaped.reserve(string.size());
+        for(char c : string) {
+            switch(c) {
+                case '"':
+                    escaped += "\\\"";
+                    break;
+                case '\\':
+                    escaped += "\\\\";
+                    break;
+                case '\n':
+                    escaped += "\\n";
+                    break;
+                case '\r':
+                    escaped += "\\r";
+                    break;
+                case '\t':
+                    escaped += "\\t";
+                    break;
+                default:
+                    if(static_cast<unsigned char>(c) < 0x20) {
+                        char code[7];
+                        std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned int>(static_cast<unsigned char>(c)));
+                        escaped += code;
+                    }
+                    else {
+                        escaped += c;
+                    }
+                    break;
+            }
+        }
+        return escaped;
+    }
+}
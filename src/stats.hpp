@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__STATS_HPP
+#define LAST_RESORT__STATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace LastResort {
+    enum Stage {
+        STAGE_READ,
+        STAGE_CACHE,
+        STAGE_PARSE,
+        STAGE_BITMAP_DECODE,
+        STAGE_FORMAT_SELECTION,
+        STAGE_SWIZZLE,
+        STAGE_DXT_SHUFFLE,
+        STAGE_MIPMAPS,
+        STAGE_BITMAP_ENCODE,
+        STAGE_SOUND_DECODE,
+        STAGE_ADPCM_ENCODE,
+        STAGE_REUSE,
+        STAGE_GENERATE,
+        STAGE_WRITE,
+
+        STAGE_COUNT
+    };
+
+    /**
+     * Get the name of a stage as shown in reports
+     * @param stage stage
+     * @return      name
+     */
+    const char *stage_name(Stage stage) noexcept;
+
+    struct StageStats {
+        std::atomic<std::uint64_t> nanoseconds = 0;
+        std::atomic<std::uint64_t> calls = 0;
+        std::atomic<std::uint64_t> bytes = 0;
+        std::atomic<std::uint64_t> pixels = 0;
+        std::atomic<std::uint64_t> samples = 0;
+    };
+
+    /**
+     * Time spent and work done in each stage of one or more conversions. This can be added to from several threads at
+     * once; time is summed across threads, so a stage that ran on several threads can report more time than passed.
+     */
+    class ConversionStats {
+    public:
+        /**
+         * Record a call to a stage
+         * @param stage       stage
+         * @param nanoseconds time spent
+         * @param bytes       bytes processed
+         * @param pixels      pixels processed
+         * @param samples     sample frames processed
+         */
+        void add(Stage stage, std::uint64_t nanoseconds, std::uint64_t bytes, std::uint64_t pixels, std::uint64_t samples) noexcept;
+
+        /**
+         * Add everything recorded in another set of stats to this one
+         * @param other other stats
+         */
+        void merge(const ConversionStats &other) noexcept;
+
+        /**
+         * Get the stats for a stage
+         * @param stage stage
+         * @return      stats
+         */
+        const StageStats &get(Stage stage) const noexcept {
+            return this->stages[stage];
+        }
+
+        /**
+         * Write the stats as an aligned table
+         * @param file    file to write to
+         * @param heading heading to write above the table
+         */
+        void print_text(std::FILE *file, const char *heading) const;
+
+        /**
+         * Write the stats as a JSON object keyed by stage name; stages that were never called are left out
+         * @param file file to write to
+         */
+        void print_json(std::FILE *file) const;
+
+    private:
+        StageStats stages[Stage::STAGE_COUNT];
+    };
+
+    /**
+     * Escape a string for use in a JSON string literal
+     * @param string string to escape
+     * @return       escaped string, without quotes
+     */
+    std::string json_escape(const std::string &string);
+
+    namespace Detail {
+        inline thread_local ConversionStats *current_stats = nullptr;
+    }
+
+    /**
+     * Collect stats for everything done on this thread (and by parallel_for() jobs it starts) until this goes out of scope
+     */
+    class StatsScope {
+    public:
+        /**
+         * Start collecting stats
+         * @param stats stats to add to, or null to collect nothing
+         */
+        explicit StatsScope(ConversionStats *stats) noexcept : previous(Detail::current_stats) {
+            Detail::current_stats = stats;
+        }
+
+        ~StatsScope() {
+            Detail::current_stats = this->previous;
+        }
+
+        StatsScope(const StatsScope &) = delete;
+        StatsScope &operator=(const StatsScope &) = delete;
+
+    private:
+        ConversionStats *previous;
+    };
+
+    /**
+     * Time a stage from construction until this goes out of scope. If no stats are being collected, this does nothing,
+     * not even read the clock.
+     */
+    class StageTimer {
+    public:
+        /**
+         * Start timing a stage
+         * @param stage   stage
+         * @param bytes   bytes processed
+         * @param pixels  pixels processed
+         * @param samples sample frames processed
+         */
+        explicit StageTimer(Stage stage, std::uint64_t bytes = 0, std::uint64_t pixels = 0, std::uint64_t samples = 0) noexcept : stats(Detail::current_stats), stage(stage), bytes(bytes), pixels(pixels), samples(samples) {
+            if(this->stats) {
+                this->start = std::chrono::steady_clock::now();
+            }
+        }
+
+        /**
+         * Count more work that was only known once the stage was underway
+         * @param bytes   bytes processed
+         * @param pixels  pixels processed
+         * @param samples sample frames processed
+         */
+        void count(std::uint64_t bytes, std::uint64_t pixels = 0, std::uint64_t samples = 0) noexcept {
+            this->bytes += bytes;
+            this->pixels += pixels;
+            this->samples += samples;
+        }
+
+        /**
+         * Stop timing now rather than when this goes out of scope
+         */
+        void finish() noexcept {
+            if(this->stats) {
+                auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->start).count();
+                this->stats->add(this->stage, static_cast<std::uint64_t>(nanoseconds), this->bytes, this->pixels, this->samples);
+                this->stats = nullptr;
+            }
+        }
+
+        ~StageTimer() {
+            this->finish();
+        }
+
+        StageTimer(const StageTimer &) = delete;
+        StageTimer &operator=(const StageTimer &) = delete;
+
+    private:
+        ConversionStats *stats;
+        Stage stage;
+        std::uint64_t bytes;
+        std::uint64_t pixels;
+        std::uint64_t samples;
+        std::chrono::steady_clock::time_point start;
+    };
+}
+
+#endif
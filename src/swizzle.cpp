@@ -0,0 +1,242 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "swizzle.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define LAST_RESORT_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace LastResort {
+    void shuffle_pixels_scalar(Invader::Pixel *pixels, std::size_t count, const PixelShuffle &shuffle) noexcept {
+        auto *bytes = reinterpret_cast<std::uint8_t *>(pixels);
+        for(std::size_t i = 0; i < count; i++, bytes += 4) {
+            std::uint8_t input[4];
+            std::memcpy(input, bytes, sizeof(input));
+            for(std::size_t j = 0; j < 4; j++) {
+                bytes[j] = shuffle.source[j] < 0 ? shuffle.constant[j] : input[shuffle.source[j]];
+            }
+        }
+    }
+
+    #ifdef LAST_RESORT_X86_SIMD
+    // Build a PSHUFB mask and OR mask for 16 bytes (4 pixels). Mask bytes with the high bit set zero the output byte.
+    static void make_shuffle_masks(const PixelShuffle &shuffle, std::uint8_t *mask, std::uint8_t *constant) noexcept {
+        for(std::size_t p = 0; p < 4; p++) {
+            for(std::size_t j = 0; j < 4; j++) {
+                auto source = shuffle.source[j];
+                mask[p * 4 + j] = source < 0 ? 0x80 : static_cast<std::uint8_t>(p * 4 + source);
+                constant[p * 4 + j] = source < 0 ? shuffle.constant[j] : 0;
+            }
+        }
+    }
+
+    __attribute__((target("ssse3"))) static void shuffle_pixels_ssse3(Invader::Pixel *pixels, std::size_t count, const PixelShuffle &shuffle) noexcept {
+        alignas(16) std::uint8_t mask[16], constant[16];
+        make_shuffle_masks(shuffle, mask, constant);
+        auto mask_vector = _mm_load_si128(reinterpret_cast<const __m128i *>(mask));
+        auto constant_vector = _mm_load_si128(reinterpret_cast<const __m128i *>(constant));
+
+        auto *bytes = reinterpret_cast<std::uint8_t *>(pixels);
+        std::size_t i = 0;
+        for(; i + 4 <= count; i += 4) {
+            auto *block = reinterpret_cast<__m128i *>(bytes + i * 4);
+            _mm_storeu_si128(block, _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128(block), mask_vector), constant_vector));
+        }
+        shuffle_pixels_scalar(pixels + i, count - i, shuffle);
+    }
+
+    __attribute__((target("avx2"))) static void shuffle_pixels_avx2(Invader::Pixel *pixels, std::size_t count, const PixelShuffle &shuffle) noexcept {
+        // VPSHUFB shuffles each 128-bit lane on its own, so both lanes use the same 16-byte mask
+        alignas(32) std::uint8_t mask[32], constant[32];
+        make_shuffle_masks(shuffle, mask, constant);
+        make_shuffle_masks(shuffle, mask + 16, constant + 16);
+        auto mask_vector = _mm256_load_si256(reinterpret_cast<const __m256i *>(mask));
+        auto constant_vector = _mm256_load_si256(reinterpret_cast<const __m256i *>(constant));
+
+        auto *bytes = reinterpret_cast<std::uint8_t *>(pixels);
+        std::size_t i = 0;
+        for(; i + 8 <= count; i += 8) {
+            auto *block = reinterpret_cast<__m256i *>(bytes + i * 4);
+            _mm256_storeu_si256(block, _mm256_or_si256(_mm256_shuffle_epi8(_mm256_loadu_si256(block), mask_vector), constant_vector));
+        }
+        shuffle_pixels_scalar(pixels + i, count - i, shuffle);
+    }
+    #endif
+
+    bool swizzle_kernel_supported(SwizzleKernel kernel) noexcept {
+        switch(kernel) {
+            case SwizzleKernel::SWIZZLE_KERNEL_SCALAR:
+                return true;
+            #ifdef LAST_RESORT_X86_SIMD
+            case SwizzleKernel::SWIZZLE_KERNEL_SSSE3: {
+                static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+                return has_ssse3;
+            }
+            case SwizzleKernel::SWIZZLE_KERNEL_AVX2: {
+                static const bool has_avx2 = __builtin_cpu_supports("avx2");
+                return has_avx2;
+            }
+            #endif
+            default:
+                return false;
+        }
+    }
+
+    const char *swizzle_kernel_name(SwizzleKernel kernel) noexcept {
+        switch(kernel) {
+            case SwizzleKernel::SWIZZLE_KERNEL_SCALAR:
+                return "scalar";
+            case SwizzleKernel::SWIZZLE_KERNEL_SSSE3:
+                return "ssse3";
+            case SwizzleKernel::SWIZZLE_KERNEL_AVX2:
+                return "avx2";
+            default:
+                return "unknown";
+        }
+    }
+
+    // Fastest kernel the CPU can run
+    static SwizzleKernel best_swizzle_kernel() noexcept {
+        static const SwizzleKernel kernel = swizzle_kernel_supported(SwizzleKernel::SWIZZLE_KERNEL_AVX2) ? SwizzleKernel::SWIZZLE_KERNEL_AVX2 : swizzle_kernel_supported(SwizzleKernel::SWIZZLE_KERNEL_SSSE3) ? SwizzleKernel::SWIZZLE_KERNEL_SSSE3 : SwizzleKernel::SWIZZLE_KERNEL_SCALAR;
+        return kernel;
+    }
+
+    void shuffle_pixels_with_kernel(Invader::Pixel *pixels, std::size_t count, const PixelShuffle &shuffle, SwizzleKernel kernel) noexcept {
+        switch(kernel) {
+            #ifdef LAST_RESORT_X86_SIMD
+            case SwizzleKernel::SWIZZLE_KERNEL_SSSE3:
+                return shuffle_pixels_ssse3(pixels, count, shuffle);
+            case SwizzleKernel::SWIZZLE_KERNEL_AVX2:
+                return shuffle_pixels_avx2(pixels, count, shuffle);
+            #endif
+            default:
+                return shuffle_pixels_scalar(pixels, count, shuffle);
+        }
+    }
+
+    void shuffle_pixels(Invader::Pixel *pixels, std::size_t count, const PixelShuffle &shuffle) noexcept {
+        shuffle_pixels_with_kernel(pixels, count, shuffle, best_swizzle_kernel());
+    }
+
+    // x / 255 for any x up to 255 * 255, without dividing
+    static inline std::uint32_t divide_by_255(std::uint32_t x) noexcept {
+        return (x + 1 + (x >> 8)) >> 8;
+    }
+
+    static std::optional<LuminanceWeights> derive_luminance_weights() noexcept {
+        auto luminance = [](std::uint8_t red, std::uint8_t green, std::uint8_t blue) {
+            Invader::Pixel pixel = {};
+            pixel.red = red;
+            pixel.green = green;
+            pixel.blue = blue;
+            pixel.alpha = 0xFF;
+            return pixel.convert_to_y8();
+        };
+
+        // With a weighted sum divided by 255, each weight is the luminance of that channel at full brightness
+        LuminanceWeights weights = { luminance(0xFF, 0, 0), luminance(0, 0xFF, 0), luminance(0, 0, 0xFF) };
+        if(weights.red + weights.green + weights.blue > 0xFF) {
+            return std::nullopt;
+        }
+
+        // Make sure that's really what it does
+        for(std::uint32_t red = 0; red <= 0xFF; red += 5) {
+            for(std::uint32_t green = 0; green <= 0xFF; green += 3) {
+                for(std::uint32_t blue = 0; blue <= 0xFF; blue += 5) {
+                    if(luminance(red, green, blue) != divide_by_255(red * weights.red + green * weights.green + blue * weights.blue)) {
+                        return std::nullopt;
+                    }
+                }
+            }
+        }
+        return weights;
+    }
+
+    const std::optional<LuminanceWeights> &get_luminance_weights() noexcept {
+        static const auto weights = derive_luminance_weights();
+        return weights;
+    }
+
+    static void hud_meter_swap_pixels_scalar(Invader::Pixel *pixels, std::size_t count, const LuminanceWeights &weights) noexcept {
+        for(std::size_t i = 0; i < count; i++) {
+            auto &pixel = pixels[i];
+            auto meter = pixel.alpha;
+            pixel.alpha = static_cast<std::uint8_t>(divide_by_255(pixel.red * weights.red + pixel.green * weights.green + pixel.blue * weights.blue));
+            pixel.red = meter;
+            pixel.green = meter;
+            pixel.blue = meter;
+        }
+    }
+
+    #ifdef LAST_RESORT_X86_SIMD
+    // Pixels are stored B, G, R, A, so in each 32-bit lane blue is the low byte and alpha the high byte. Every product
+    // fits in the low 16 bits of its lane, so 16-bit multiplies do.
+    __attribute__((target("ssse3"))) static void hud_meter_swap_pixels_ssse3(Invader::Pixel *pixels, std::size_t count, const LuminanceWeights &weights) noexcept {
+        auto byte_mask = _mm_set1_epi32(0xFF);
+        auto red_weight = _mm_set1_epi32(weights.red);
+        auto green_weight = _mm_set1_epi32(weights.green);
+        auto blue_weight = _mm_set1_epi32(weights.blue);
+        auto one = _mm_set1_epi32(1);
+
+        std::size_t i = 0;
+        for(; i + 4 <= count; i += 4) {
+            auto *block = reinterpret_cast<__m128i *>(pixels + i);
+            auto input = _mm_loadu_si128(block);
+            auto blue = _mm_and_si128(input, byte_mask);
+            auto green = _mm_and_si128(_mm_srli_epi32(input, 8), byte_mask);
+            auto red = _mm_and_si128(_mm_srli_epi32(input, 16), byte_mask);
+            auto meter = _mm_srli_epi32(input, 24);
+
+            auto sum = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi16(red, red_weight), _mm_mullo_epi16(green, green_weight)), _mm_mullo_epi16(blue, blue_weight));
+            auto mask = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(sum, one), _mm_srli_epi32(sum, 8)), 8);
+
+            auto output = _mm_or_si128(_mm_or_si128(meter, _mm_slli_epi32(meter, 8)), _mm_or_si128(_mm_slli_epi32(meter, 16), _mm_slli_epi32(mask, 24)));
+            _mm_storeu_si128(block, output);
+        }
+        hud_meter_swap_pixels_scalar(pixels + i, count - i, weights);
+    }
+
+    __attribute__((target("avx2"))) static void hud_meter_swap_pixels_avx2(Invader::Pixel *pixels, std::size_t count, const LuminanceWeights &weights) noexcept {
+        auto byte_mask = _mm256_set1_epi32(0xFF);
+        auto red_weight = _mm256_set1_epi32(weights.red);
+        auto green_weight = _mm256_set1_epi32(weights.green);
+        auto blue_weight = _mm256_set1_epi32(weights.blue);
+        auto one = _mm256_set1_epi32(1);
+
+        std::size_t i = 0;
+        for(; i + 8 <= count; i += 8) {
+            auto *block = reinterpret_cast<__m256i *>(pixels + i);
+            auto input = _mm256_loadu_si256(block);
+            auto blue = _mm256_and_si256(input, byte_mask);
+            auto green = _mm256_and_si256(_mm256_srli_epi32(input, 8), byte_mask);
+            auto red = _mm256_and_si256(_mm256_srli_epi32(input, 16), byte_mask);
+            auto meter = _mm256_srli_epi32(input, 24);
+
+            auto sum = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi16(red, red_weight), _mm256_mullo_epi16(green, green_weight)), _mm256_mullo_epi16(blue, blue_weight));
+            auto mask = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(sum, one), _mm256_srli_epi32(sum, 8)), 8);
+
+            auto output = _mm256_or_si256(_mm256_or_si256(meter, _mm256_slli_epi32(meter, 8)), _mm256_or_si256(_mm256_slli_epi32(meter, 16), _mm256_slli_epi32(mask, 24)));
+            _mm256_storeu_si256(block, output);
+        }
+        hud_meter_swap_pixels_scalar(pixels + i, count - i, weights);
+    }
+    #endif
+
+    void hud_meter_swap_pixels_with_kernel(Invader::Pixel *pixels, std::size_t count, const LuminanceWeights &weights, SwizzleKernel kernel) noexcept {
+        switch(kernel) {
+            #ifdef LAST_RESORT_X86_SIMD
+            case SwizzleKernel::SWIZZLE_KERNEL_SSSE3:
+                return hud_meter_swap_pixels_ssse3(pixels, count, weights);
+            case SwizzleKernel::SWIZZLE_KERNEL_AVX2:
+                return hud_meter_swap_pixels_avx2(pixels, count, weights);
+            #endif
+            default:
+                return hud_meter_swap_pixels_scalar(pixels, count, weights);
+        }
+    }
+
+    void hud_meter_swap_pixels(Invader::Pixel *pixels, std::size_t count, const LuminanceWeights &weights) noexcept {
+        hud_meter_swap_pixels_with_kernel(pixels, count, weights, best_swizzle_kernel());
+    }
+}
@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__SWIZZLE_HPP
+#define LAST_RESORT__SWIZZLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+#include <invader/bitmap/pixel.hpp>
+
+namespace LastResort {
+    static_assert(sizeof(Invader::Pixel) == 4, "Invader::Pixel must be 32-bit");
+
+    /**
+     * Byte shuffle applied to every 32-bit pixel
+     */
+    struct PixelShuffle {
+        /** For each output byte, the input byte it comes from, or -1 if it is constant */
+        std::int8_t source[4];
+
+        /** For each output byte, the constant value to use if source is -1 */
+        std::uint8_t constant[4];
+
+        /**
+         * Get whether or not this shuffle leaves pixels untouched
+         * @return true if identity
+         */
+        bool is_identity() const noexcept {
+            for(std::size_t j = 0; j < 4; j++) {
+                if(this->source[j] != static_cast<std::int8_t>(j)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    enum SwizzleKernel {
+        SWIZZLE_KERNEL_SCALAR,
+        SWIZZLE_KERNEL_SSSE3,
+        SWIZZLE_KERNEL_AVX2,
+
+        SWIZZLE_KERNEL_COUNT
+    };
+
+    /**
+     * Get whether or not the CPU can run a kernel
+     * @param kernel kernel
+     * @return       true if supported
+     */
+    bool swizzle_kernel_supported(SwizzleKernel kernel) noexcept;
+
+    /**
+     * Get the name of a kernel
+     * @param kernel kernel
+     * @return       name
+     */
+    const char *swizzle_kernel_name(SwizzleKernel kernel) noexcept;
+
+    /**
+     * Apply a byte shuffle to a run of pixels, using SSSE3 or AVX2 if the CPU supports it
+     * @param pixels  pixels to shuffle
+     * @param count   number of pixels
+     * @param shuffle shuffle to apply
+     */
+    void shuffle_pixels(Invader::Pixel *pixels, std::size_t count, const PixelShuffle &shuffle) noexcept;
+
+    /**
+     * Apply a byte shuffle to a run of pixels one pixel at a time
+     * @param pixels  pixels to shuffle
+     * @param count   number of pixels
+     * @param shuffle shuffle to apply
+     */
+    void shuffle_pixels_scalar(Invader::Pixel *pixels, std::size_t count, const PixelShuffle &shuffle) noexcept;
+
+    /**
+     * Apply a byte shuffle to a run of pixels with a specific kernel
+     * @param pixels  pixels to shuffle
+     * @param count   number of pixels
+     * @param shuffle shuffle to apply
+     * @param kernel  kernel to use; it must be supported
+     */
+    void shuffle_pixels_with_kernel(Invader::Pixel *pixels, std::size_t count, const PixelShuffle &shuffle, SwizzleKernel kernel) noexcept;
+
+    /**
+     * Weights of Invader::Pixel::convert_to_y8(), which is (red * red_weight + green * green_weight + blue * blue_weight) / 255
+     */
+    struct LuminanceWeights {
+        std::uint8_t red;
+        std::uint8_t green;
+        std::uint8_t blue;
+    };
+
+    /**
+     * Get the weights Invader::Pixel::convert_to_y8() uses, working them out on first use by running it on pure red,
+     * green, and blue, then checking the weighted sum gives the same result on a spread of other colors
+     * @return weights, or std::nullopt if convert_to_y8() isn't a weighted sum that can be done this way
+     */
+    const std::optional<LuminanceWeights> &get_luminance_weights() noexcept;
+
+    /**
+     * Move the luminance of each pixel's color into its alpha channel and its alpha into its color channels (the HUD
+     * meter swap), using SSSE3 or AVX2 if the CPU supports it
+     * @param pixels  pixels to modify
+     * @param count   number of pixels
+     * @param weights luminance weights from get_luminance_weights()
+     */
+    void hud_meter_swap_pixels(Invader::Pixel *pixels, std::size_t count, const LuminanceWeights &weights) noexcept;
+
+    /**
+     * Do the HUD meter swap with a specific kernel (see hud_meter_swap_pixels())
+     * @param pixels  pixels to modify
+     * @param count   number of pixels
+     * @param weights luminance weights from get_luminance_weights()
+     * @param kernel  kernel to use; it must be supported
+     */
+    void hud_meter_swap_pixels_with_kernel(Invader::Pixel *pixels, std::size_t count, const LuminanceWeights &weights, SwizzleKernel kernel) noexcept;
+
+    /**
+     * Work out the byte shuffle a per-pixel function performs by running it on a few known pixels and checking the
+     * result, so the function stays the reference for what the shuffle does.
+     * @param modify_pixel per-pixel function
+     * @return             shuffle, or std::nullopt if the function is not a pure byte shuffle (e.g. it does math)
+     */
+    template <typename F> std::optional<PixelShuffle> derive_pixel_shuffle(const F &modify_pixel) {
+        static constexpr const std::uint8_t probes[][4] = {
+            { 0x01, 0x02, 0x03, 0x04 },
+            { 0x81, 0x82, 0x83, 0x84 },
+            { 0x37, 0xC1, 0x5E, 0x9A }
+        };
+        static constexpr const std::size_t probe_count = sizeof(probes) / sizeof(*probes);
+
+        std::uint8_t results[probe_count][4];
+        for(std::size_t p = 0; p < probe_count; p++) {
+            Invader::Pixel pixel;
+            std::memcpy(&pixel, probes[p], sizeof(pixel));
+            modify_pixel(pixel);
+            std::memcpy(results[p], &pixel, sizeof(pixel));
+        }
+
+        PixelShuffle shuffle = {};
+        for(std::size_t j = 0; j < 4; j++) {
+            // Is it the same value regardless of input?
+            bool constant = true;
+            for(std::size_t p = 1; p < probe_count; p++) {
+                constant = constant && results[p][j] == results[0][j];
+            }
+            if(constant) {
+                shuffle.source[j] = -1;
+                shuffle.constant[j] = results[0][j];
+                continue;
+            }
+
+            // Otherwise it has to come straight from one input byte
+            shuffle.source[j] = -1;
+            for(std::size_t k = 0; k < 4 && shuffle.source[j] < 0; k++) {
+                bool matches = true;
+                for(std::size_t p = 0; p < probe_count; p++) {
+                    matches = matches && results[p][j] == probes[p][k];
+                }
+                if(matches) {
+                    shuffle.source[j] = static_cast<std::int8_t>(k);
+                }
+            }
+            if(shuffle.source[j] < 0) {
+                return std::nullopt;
+            }
+        }
+
+        return shuffle;
+    }
+
+    /**
+     * Get the byte shuffle a per-pixel function performs, working it out on first use
+     * @param modify_pixel per-pixel function
+     * @return             shuffle, or std::nullopt if the function is not a pure byte shuffle
+     */
+    template <typename F> const std::optional<PixelShuffle> &get_pixel_shuffle(const F &modify_pixel) {
+        static const auto shuffle = derive_pixel_shuffle(modify_pixel);
+        return shuffle;
+    }
+
+    /**
+     * Apply a per-pixel function to a run of pixels.
+     *
+     * If the function can also be called with a run of pixels and a count, that is used instead, so functions that do
+     * math can supply their own vectorized version. If it only moves bytes around, it is run as a vectorized byte
+     * shuffle. Otherwise, it is called directly for each pixel, where it can be inlined.
+     *
+     * @param pixels       pixels to modify
+     * @param count        number of pixels
+     * @param modify_pixel per-pixel function
+     */
+    template <typename F> void swizzle_pixels(Invader::Pixel *pixels, std::size_t count, const F &modify_pixel) {
+        if constexpr(std::is_invocable_v<const F &, Invader::Pixel *, std::size_t>) {
+            modify_pixel(pixels, count);
+            return;
+        }
+
+        auto &shuffle = get_pixel_shuffle(modify_pixel);
+        if(shuffle.has_value()) {
+            if(!shuffle->is_identity()) {
+                shuffle_pixels(pixels, count, *shuffle);
+            }
+        }
+        else {
+            for(std::size_t i = 0; i < count; i++) {
+                modify_pixel(pixels[i]);
+            }
+        }
+    }
+}
+
+#endif
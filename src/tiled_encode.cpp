@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cstring>
+#include <invader/bitmap/bitmap_encode.hpp>
+
+#include "tiled_encode.hpp"
+#include "buffer_pool.hpp"
+#include "error.hpp"
+#include "parallel.hpp"
+
+namespace LastResort {
+    using BitmapDataType = Invader::HEK::BitmapDataType;
+    using BitmapDataFormat = Invader::HEK::BitmapDataFormat;
+
+    // A piece of the chain that can be encoded on its own
+    struct EncodeJob {
+        std::size_t first_pixel;
+        std::size_t output_offset;
+        std::size_t output_size;
+        std::size_t width;
+        std::size_t height;
+        std::size_t depth;
+        BitmapDataType type;
+    };
+
+    // About as many pixels per job as swizzling uses; DXT blocks are 4x4, so strips are always whole block rows
+    static constexpr const std::size_t pixels_per_job = 65536;
+    static constexpr const std::size_t block_length = 4;
+
+    static std::vector<std::byte> encode_job(const Invader::Pixel *chain, BitmapDataFormat format, const EncodeJob &job, bool dither) {
+        return Invader::BitmapEncode::encode_bitmap(reinterpret_cast<const std::byte *>(chain + job.first_pixel), BitmapDataFormat::BITMAP_DATA_FORMAT_A8R8G8B8, format, job.width, job.height, job.depth, job.type, 0, dither, dither, dither, dither);
+    }
+
+    std::vector<std::byte> encode_bitmap_tiled(const Invader::Pixel *chain, BitmapDataFormat format, std::size_t width, std::size_t height, std::size_t depth, BitmapDataType type, std::size_t mipmap_count, bool dither) {
+        bool is_3d = type == BitmapDataType::BITMAP_DATA_TYPE_3D_TEXTURE;
+        std::size_t face_count = type == BitmapDataType::BITMAP_DATA_TYPE_CUBE_MAP ? 6 : 1;
+        std::size_t output_size = Invader::BitmapEncode::bitmap_data_size(width, height, depth, mipmap_count, format, type);
+
+        // Work out where every level and strip goes first
+        std::vector<EncodeJob> jobs;
+        std::size_t level_width = width, level_height = height, level_depth = is_3d ? depth : 1;
+        std::size_t first_pixel = 0, output_offset = 0;
+        for(std::size_t m = 0; m <= mipmap_count; m++) {
+            // Take the level's size from the chain's so this always agrees with Invader on where each level starts
+            std::size_t level_end = m == mipmap_count ? output_size : Invader::BitmapEncode::bitmap_data_size(width, height, depth, m, format, type);
+            std::size_t level_output_size = level_end - output_offset;
+            std::size_t level_pixels = level_width * level_height * level_depth * face_count;
+
+            // 3D slices may depend on each other, so those levels (and any small level) are done in one go
+            if(is_3d || level_pixels <= pixels_per_job) {
+                jobs.push_back(EncodeJob { first_pixel, output_offset, level_output_size, level_width, level_height, level_depth, type });
+            }
+
+            // Otherwise, split each face into strips of block rows. A cube map level holds all six faces one after
+            // another, each taking up a sixth of the level (see the bench's cube-map-layout checks).
+            else {
+                std::size_t rows_per_strip = std::max(block_length, pixels_per_job / level_width / block_length * block_length);
+                std::size_t face_output_offset = output_offset;
+                for(std::size_t f = 0; f < face_count; f++) {
+                    std::size_t strip_output_offset = face_output_offset;
+                    for(std::size_t row = 0; row < level_height; row += rows_per_strip) {
+                        std::size_t strip_height = std::min(rows_per_strip, level_height - row);
+                        std::size_t strip_output_size = Invader::BitmapEncode::bitmap_data_size(level_width, strip_height, 1, 0, format, BitmapDataType::BITMAP_DATA_TYPE_2D_TEXTURE);
+                        jobs.push_back(EncodeJob { first_pixel + (f * level_height + row) * level_width, strip_output_offset, strip_output_size, level_width, strip_height, 1, BitmapDataType::BITMAP_DATA_TYPE_2D_TEXTURE });
+                        strip_output_offset += strip_output_size;
+                    }
+                    face_output_offset += level_output_size / face_count;
+                }
+            }
+
+            first_pixel += level_pixels;
+            output_offset = level_end;
+            level_width = std::max<std::size_t>(level_width / 2, 1);
+            level_height = std::max<std::size_t>(level_height / 2, 1);
+            level_depth = is_3d ? std::max<std::size_t>(level_depth / 2, 1) : 1;
+        }
+
+        // Nothing to split up
+        if(jobs.size() == 1) {
+            return encode_job(chain, format, jobs[0], dither);
+        }
+
+        auto output = BufferPool::shared().acquire(output_size);
+        output.resize(output_size);
+        LastResort::parallel_for(jobs.size(), [&chain, &format, &jobs, &dither, &output](std::size_t j) {
+            auto &job = jobs[j];
+            auto encoded = encode_job(chain, format, job, dither);
+            if(encoded.size() != job.output_size || job.output_offset + job.output_size > output.size()) {
+                throw ConversionError("Encoded bitmap data is the wrong size");
+            }
+            std::memcpy(output.data() + job.output_offset, encoded.data(), encoded.size());
+            BufferPool::shared().release(std::move(encoded));
+        });
+        return output;
+    }
+}
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__TILED_ENCODE_HPP
+#define LAST_RESORT__TILED_ENCODE_HPP
+
+#include <cstddef>
+#include <vector>
+#include <invader/bitmap/pixel.hpp>
+#include <invader/tag/hek/header.hpp>
+
+namespace LastResort {
+    /**
+     * Encode a decoded mipmap chain (as laid out by generate_mipmap_chain()) to the given format, spread across threads.
+     *
+     * Every mipmap level is its own job, and big 2D textures and cube map faces are further split into strips of whole
+     * 4x4 block rows. Without dithering, every block and pixel is encoded independently, so this gives exactly what
+     * encoding the whole chain at once gives.
+     *
+     * With dithering, error is diffused within each strip only, so a faint seam is possible every few dozen rows where
+     * diffusion restarts. Strips are sized from the bitmap's width alone, never from the thread count, so the result is
+     * the same no matter how many threads are used, including one.
+     *
+     * @param chain        decoded A8R8G8B8 mipmap chain
+     * @param format       format to encode to
+     * @param width        width of the base level
+     * @param height       height of the base level
+     * @param depth        depth of the base level (only used for 3D textures)
+     * @param type         bitmap type
+     * @param mipmap_count number of mipmaps (not counting the base level)
+     * @param dither       use dithering when possible
+     * @return             encoded data
+     */
+    std::vector<std::byte> encode_bitmap_tiled(const Invader::Pixel *chain, Invader::HEK::BitmapDataFormat format, std::size_t width, std::size_t height, std::size_t depth, Invader::HEK::BitmapDataType type, std::size_t mipmap_count, bool dither);
+}
+
+#endif
@@ -0,0 +1,385 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "xbox_adpcm.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define LAST_RESORT_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace LastResort {
+    static constexpr const std::int32_t STEP_TABLE[89] = {
+        7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107,
+        118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+        1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894,
+        6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+        32767
+    };
+    static constexpr const std::int32_t MAX_STEP_INDEX = 88;
+
+    // Samples the encoder is run over (without writing anything) to find a block's starting step index
+    static constexpr const std::size_t WARMUP_FRAMES = 16;
+
+    // Frames each block is encoded from: its own, then the first frame of the next block for the unused last nibble
+    static constexpr const std::size_t ENCODED_FRAMES = XBOX_ADPCM_FRAMES_PER_BLOCK + 1;
+
+    std::size_t xbox_adpcm_size(std::size_t frame_count, std::size_t channel_count) noexcept {
+        return (frame_count + XBOX_ADPCM_FRAMES_PER_BLOCK - 1) / XBOX_ADPCM_FRAMES_PER_BLOCK * XBOX_ADPCM_BLOCK_SIZE * channel_count;
+    }
+
+    static std::int32_t read_sample(const std::byte *pcm, std::size_t frame, std::size_t channel, std::size_t channel_count, std::size_t available_frame_count, bool big_endian) noexcept {
+        if(frame >= available_frame_count) {
+            return 0;
+        }
+        auto *bytes = reinterpret_cast<const std::uint8_t *>(pcm) + (frame * channel_count + channel) * sizeof(std::int16_t);
+        auto value = big_endian ? static_cast<std::uint16_t>(bytes[0] << 8 | bytes[1]) : static_cast<std::uint16_t>(bytes[1] << 8 | bytes[0]);
+        return static_cast<std::int16_t>(value);
+    }
+
+    // Write one channel of one block: the header, then every 8 nibbles in 4 bytes, interleaved with the other channels
+    static void write_block_channel(std::byte *output, std::size_t block, std::size_t channel, std::size_t channel_count, std::int32_t first_sample, std::int32_t step_index, const std::int32_t *nibbles, std::size_t nibble_stride) noexcept {
+        auto *block_data = reinterpret_cast<std::uint8_t *>(output) + block * XBOX_ADPCM_BLOCK_SIZE * channel_count;
+        auto *header = block_data + channel * 4;
+        auto header_sample = static_cast<std::uint16_t>(first_sample);
+        header[0] = static_cast<std::uint8_t>(header_sample);
+        header[1] = static_cast<std::uint8_t>(header_sample >> 8);
+        header[2] = static_cast<std::uint8_t>(step_index);
+        header[3] = 0;
+
+        auto *data = block_data + channel_count * 4;
+        for(std::size_t group = 0; group < XBOX_ADPCM_FRAMES_PER_BLOCK / 8; group++) {
+            auto *group_data = data + (group * channel_count + channel) * 4;
+            for(std::size_t b = 0; b < 4; b++) {
+                auto low = nibbles[(group * 8 + b * 2) * nibble_stride];
+                auto high = nibbles[(group * 8 + b * 2 + 1) * nibble_stride];
+                group_data[b] = static_cast<std::uint8_t>(low | high << 4);
+            }
+        }
+    }
+
+    // Encode one sample, updating the predictor and step index exactly as a decoder would
+    static std::int32_t encode_sample(std::int32_t sample, std::int32_t &predictor, std::int32_t &step_index) noexcept {
+        std::int32_t difference = sample - predictor;
+        bool negative = difference < 0;
+        std::int32_t magnitude = negative ? -difference : difference;
+        std::int32_t step = STEP_TABLE[step_index];
+        std::int32_t nibble = 0;
+        std::int32_t predicted_difference = step >> 3;
+
+        if(magnitude >= step) {
+            nibble |= 4;
+            magnitude -= step;
+            predicted_difference += step;
+        }
+        if(magnitude >= (step >> 1)) {
+            nibble |= 2;
+            magnitude -= step >> 1;
+            predicted_difference += step >> 1;
+        }
+        if(magnitude >= (step >> 2)) {
+            nibble |= 1;
+            predicted_difference += step >> 2;
+        }
+
+        predictor = std::clamp(negative ? predictor - predicted_difference : predictor + predicted_difference, -32768, 32767);
+        step_index = std::clamp(step_index + (nibble < 4 ? -1 : (nibble - 3) * 2), 0, MAX_STEP_INDEX);
+        return nibble | (negative ? 8 : 0);
+    }
+
+    // Every encoder below reads up to available_frame_count frames, so the last nibble of the last block can be encoded
+    // from the frame after it when there is one; past that, it reads silence
+    static void encode_xbox_adpcm_scalar(const std::byte *pcm, std::size_t frame_count, std::size_t available_frame_count, std::size_t channel_count, bool big_endian, std::byte *output) noexcept {
+        std::size_t block_count = (frame_count + XBOX_ADPCM_FRAMES_PER_BLOCK - 1) / XBOX_ADPCM_FRAMES_PER_BLOCK;
+        for(std::size_t block = 0; block < block_count; block++) {
+            for(std::size_t channel = 0; channel < channel_count; channel++) {
+                std::int32_t samples[ENCODED_FRAMES];
+                for(std::size_t f = 0; f < ENCODED_FRAMES; f++) {
+                    samples[f] = read_sample(pcm, block * XBOX_ADPCM_FRAMES_PER_BLOCK + f, channel, channel_count, available_frame_count, big_endian);
+                }
+
+                std::int32_t predictor = samples[0];
+                std::int32_t step_index = 0;
+                for(std::size_t f = 1; f <= WARMUP_FRAMES; f++) {
+                    encode_sample(samples[f], predictor, step_index);
+                }
+                std::int32_t first_step_index = step_index;
+
+                std::int32_t nibbles[XBOX_ADPCM_FRAMES_PER_BLOCK];
+                predictor = samples[0];
+                for(std::size_t f = 1; f < ENCODED_FRAMES; f++) {
+                    nibbles[f - 1] = encode_sample(samples[f], predictor, step_index);
+                }
+
+                write_block_channel(output, block, channel, channel_count, samples[0], first_step_index, nibbles, 1);
+            }
+        }
+    }
+
+    #ifdef LAST_RESORT_X86_SIMD
+    // Load the samples each of several block/channel lanes is encoded from at once, converting them to 32-bit as they go
+    // in. Each row holds one frame for every lane.
+    static void stage_lanes(const std::byte *pcm, std::size_t available_frame_count, std::size_t channel_count, bool big_endian, std::size_t first_lane, std::size_t lane_count, std::size_t lane_stride, std::int32_t *staged) noexcept {
+        std::memset(staged, 0, ENCODED_FRAMES * lane_stride * sizeof(*staged));
+        for(std::size_t l = 0; l < lane_count; l++) {
+            std::size_t block = (first_lane + l) / channel_count;
+            std::size_t channel = (first_lane + l) % channel_count;
+            std::size_t first_frame = block * XBOX_ADPCM_FRAMES_PER_BLOCK;
+
+            // Only the last block can run off the end, so skip the bounds checks (and the endianness check) for the rest
+            if(first_frame + ENCODED_FRAMES > available_frame_count) {
+                for(std::size_t f = 0; f < ENCODED_FRAMES; f++) {
+                    staged[f * lane_stride + l] = read_sample(pcm, first_frame + f, channel, channel_count, available_frame_count, big_endian);
+                }
+                continue;
+            }
+
+            auto *bytes = reinterpret_cast<const std::uint8_t *>(pcm) + (first_frame * channel_count + channel) * sizeof(std::int16_t);
+            std::size_t frame_size = channel_count * sizeof(std::int16_t);
+            std::size_t high = big_endian ? 0 : 1;
+            for(std::size_t f = 0; f < ENCODED_FRAMES; f++, bytes += frame_size) {
+                staged[f * lane_stride + l] = static_cast<std::int16_t>(static_cast<std::uint16_t>(bytes[high] << 8 | bytes[high ^ 1]));
+            }
+        }
+    }
+
+    // Run a lane kernel over every block and channel
+    template <std::size_t lane_count, typename F> static void encode_lanes(const std::byte *pcm, std::size_t frame_count, std::size_t available_frame_count, std::size_t channel_count, bool big_endian, std::byte *output, const F &encode_block_lanes) noexcept {
+        alignas(32) std::int32_t staged[ENCODED_FRAMES * lane_count];
+        alignas(32) std::int32_t nibbles[XBOX_ADPCM_FRAMES_PER_BLOCK * lane_count];
+        alignas(32) std::int32_t step_indices[lane_count];
+
+        std::size_t total_lanes = (frame_count + XBOX_ADPCM_FRAMES_PER_BLOCK - 1) / XBOX_ADPCM_FRAMES_PER_BLOCK * channel_count;
+        for(std::size_t first_lane = 0; first_lane < total_lanes; first_lane += lane_count) {
+            std::size_t lanes = std::min(lane_count, total_lanes - first_lane);
+            stage_lanes(pcm, available_frame_count, channel_count, big_endian, first_lane, lanes, lane_count, staged);
+            encode_block_lanes(staged, nibbles, step_indices);
+            for(std::size_t l = 0; l < lanes; l++) {
+                write_block_channel(output, (first_lane + l) / channel_count, (first_lane + l) % channel_count, channel_count, staged[l], step_indices[l], nibbles + l, lane_count);
+            }
+        }
+    }
+
+    __attribute__((target("sse4.1"))) static inline __m128i encode_samples_sse41(__m128i sample, __m128i &predictor, __m128i &step_index) noexcept {
+        alignas(16) std::int32_t indices[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(indices), step_index);
+        auto step = _mm_setr_epi32(STEP_TABLE[indices[0]], STEP_TABLE[indices[1]], STEP_TABLE[indices[2]], STEP_TABLE[indices[3]]);
+
+        auto difference = _mm_sub_epi32(sample, predictor);
+        auto negative = _mm_cmplt_epi32(difference, _mm_setzero_si128());
+        auto magnitude = _mm_abs_epi32(difference);
+        auto predicted_difference = _mm_srai_epi32(step, 3);
+
+        auto below = _mm_cmpgt_epi32(step, magnitude);
+        auto taken = _mm_andnot_si128(below, step);
+        magnitude = _mm_sub_epi32(magnitude, taken);
+        predicted_difference = _mm_add_epi32(predicted_difference, taken);
+        auto nibble = _mm_andnot_si128(below, _mm_set1_epi32(4));
+
+        auto half_step = _mm_srai_epi32(step, 1);
+        below = _mm_cmpgt_epi32(half_step, magnitude);
+        taken = _mm_andnot_si128(below, half_step);
+        magnitude = _mm_sub_epi32(magnitude, taken);
+        predicted_difference = _mm_add_epi32(predicted_difference, taken);
+        nibble = _mm_or_si128(nibble, _mm_andnot_si128(below, _mm_set1_epi32(2)));
+
+        auto quarter_step = _mm_srai_epi32(step, 2);
+        below = _mm_cmpgt_epi32(quarter_step, magnitude);
+        predicted_difference = _mm_add_epi32(predicted_difference, _mm_andnot_si128(below, quarter_step));
+        nibble = _mm_or_si128(nibble, _mm_andnot_si128(below, _mm_set1_epi32(1)));
+
+        predictor = _mm_blendv_epi8(_mm_add_epi32(predictor, predicted_difference), _mm_sub_epi32(predictor, predicted_difference), negative);
+        predictor = _mm_min_epi32(_mm_max_epi32(predictor, _mm_set1_epi32(-32768)), _mm_set1_epi32(32767));
+
+        auto adjustment = _mm_blendv_epi8(_mm_set1_epi32(-1), _mm_sub_epi32(_mm_add_epi32(nibble, nibble), _mm_set1_epi32(6)), _mm_cmpgt_epi32(nibble, _mm_set1_epi32(3)));
+        step_index = _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(step_index, adjustment), _mm_setzero_si128()), _mm_set1_epi32(MAX_STEP_INDEX));
+
+        return _mm_or_si128(nibble, _mm_and_si128(negative, _mm_set1_epi32(8)));
+    }
+
+    // Two independent sets of lanes are run side by side so one can go while the other waits on its last result
+    __attribute__((target("sse4.1"))) static void encode_block_lanes_sse41(const std::int32_t *staged, std::int32_t *nibbles, std::int32_t *step_indices) noexcept {
+        auto *rows = reinterpret_cast<const __m128i *>(staged);
+        auto *nibble_rows = reinterpret_cast<__m128i *>(nibbles);
+
+        __m128i predictor[2] = { rows[0], rows[1] };
+        __m128i step_index[2] = { _mm_setzero_si128(), _mm_setzero_si128() };
+        for(std::size_t f = 1; f <= WARMUP_FRAMES; f++) {
+            encode_samples_sse41(rows[f * 2], predictor[0], step_index[0]);
+            encode_samples_sse41(rows[f * 2 + 1], predictor[1], step_index[1]);
+        }
+        _mm_store_si128(reinterpret_cast<__m128i *>(step_indices), step_index[0]);
+        _mm_store_si128(reinterpret_cast<__m128i *>(step_indices + 4), step_index[1]);
+
+        predictor[0] = rows[0];
+        predictor[1] = rows[1];
+        for(std::size_t f = 1; f < ENCODED_FRAMES; f++) {
+            _mm_store_si128(nibble_rows + (f - 1) * 2, encode_samples_sse41(rows[f * 2], predictor[0], step_index[0]));
+            _mm_store_si128(nibble_rows + (f - 1) * 2 + 1, encode_samples_sse41(rows[f * 2 + 1], predictor[1], step_index[1]));
+        }
+    }
+
+    __attribute__((target("avx2"))) static inline __m256i encode_samples_avx2(__m256i sample, __m256i &predictor, __m256i &step_index) noexcept {
+        auto step = _mm256_i32gather_epi32(STEP_TABLE, step_index, 4);
+
+        auto difference = _mm256_sub_epi32(sample, predictor);
+        auto negative = _mm256_cmpgt_epi32(_mm256_setzero_si256(), difference);
+        auto magnitude = _mm256_abs_epi32(difference);
+        auto predicted_difference = _mm256_srai_epi32(step, 3);
+
+        auto below = _mm256_cmpgt_epi32(step, magnitude);
+        auto taken = _mm256_andnot_si256(below, step);
+        magnitude = _mm256_sub_epi32(magnitude, taken);
+        predicted_difference = _mm256_add_epi32(predicted_difference, taken);
+        auto nibble = _mm256_andnot_si256(below, _mm256_set1_epi32(4));
+
+        auto half_step = _mm256_srai_epi32(step, 1);
+        below = _mm256_cmpgt_epi32(half_step, magnitude);
+        taken = _mm256_andnot_si256(below, half_step);
+        magnitude = _mm256_sub_epi32(magnitude, taken);
+        predicted_difference = _mm256_add_epi32(predicted_difference, taken);
+        nibble = _mm256_or_si256(nibble, _mm256_andnot_si256(below, _mm256_set1_epi32(2)));
+
+        auto quarter_step = _mm256_srai_epi32(step, 2);
+        below = _mm256_cmpgt_epi32(quarter_step, magnitude);
+        predicted_difference = _mm256_add_epi32(predicted_difference, _mm256_andnot_si256(below, quarter_step));
+        nibble = _mm256_or_si256(nibble, _mm256_andnot_si256(below, _mm256_set1_epi32(1)));
+
+        predictor = _mm256_blendv_epi8(_mm256_add_epi32(predictor, predicted_difference), _mm256_sub_epi32(predictor, predicted_difference), negative);
+        predictor = _mm256_min_epi32(_mm256_max_epi32(predictor, _mm256_set1_epi32(-32768)), _mm256_set1_epi32(32767));
+
+        auto adjustment = _mm256_blendv_epi8(_mm256_set1_epi32(-1), _mm256_sub_epi32(_mm256_add_epi32(nibble, nibble), _mm256_set1_epi32(6)), _mm256_cmpgt_epi32(nibble, _mm256_set1_epi32(3)));
+        step_index = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(step_index, adjustment), _mm256_setzero_si256()), _mm256_set1_epi32(MAX_STEP_INDEX));
+
+        return _mm256_or_si256(nibble, _mm256_and_si256(negative, _mm256_set1_epi32(8)));
+    }
+
+    __attribute__((target("avx2"))) static void encode_block_lanes_avx2(const std::int32_t *staged, std::int32_t *nibbles, std::int32_t *step_indices) noexcept {
+        auto *rows = reinterpret_cast<const __m256i *>(staged);
+        auto *nibble_rows = reinterpret_cast<__m256i *>(nibbles);
+
+        __m256i predictor[2] = { rows[0], rows[1] };
+        __m256i step_index[2] = { _mm256_setzero_si256(), _mm256_setzero_si256() };
+        for(std::size_t f = 1; f <= WARMUP_FRAMES; f++) {
+            encode_samples_avx2(rows[f * 2], predictor[0], step_index[0]);
+            encode_samples_avx2(rows[f * 2 + 1], predictor[1], step_index[1]);
+        }
+        _mm256_store_si256(reinterpret_cast<__m256i *>(step_indices), step_index[0]);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(step_indices + 8), step_index[1]);
+
+        predictor[0] = rows[0];
+        predictor[1] = rows[1];
+        for(std::size_t f = 1; f < ENCODED_FRAMES; f++) {
+            _mm256_store_si256(nibble_rows + (f - 1) * 2, encode_samples_avx2(rows[f * 2], predictor[0], step_index[0]));
+            _mm256_store_si256(nibble_rows + (f - 1) * 2 + 1, encode_samples_avx2(rows[f * 2 + 1], predictor[1], step_index[1]));
+        }
+    }
+    #endif
+
+    bool adpcm_kernel_supported(AdpcmKernel kernel) noexcept {
+        switch(kernel) {
+            case AdpcmKernel::ADPCM_KERNEL_SCALAR:
+                return true;
+            #ifdef LAST_RESORT_X86_SIMD
+            case AdpcmKernel::ADPCM_KERNEL_SSE41: {
+                static const bool has_sse41 = __builtin_cpu_supports("sse4.1");
+                return has_sse41;
+            }
+            case AdpcmKernel::ADPCM_KERNEL_AVX2: {
+                static const bool has_avx2 = __builtin_cpu_supports("avx2");
+                return has_avx2;
+            }
+            #endif
+            default:
+                return false;
+        }
+    }
+
+    const char *adpcm_kernel_name(AdpcmKernel kernel) noexcept {
+        switch(kernel) {
+            case AdpcmKernel::ADPCM_KERNEL_SCALAR:
+                return "scalar";
+            case AdpcmKernel::ADPCM_KERNEL_SSE41:
+                return "sse4.1";
+            case AdpcmKernel::ADPCM_KERNEL_AVX2:
+                return "avx2";
+            default:
+                return "unknown";
+        }
+    }
+
+    static void encode_blocks(const std::byte *pcm, std::size_t frame_count, std::size_t available_frame_count, std::size_t channel_count, bool big_endian, std::byte *output, AdpcmKernel kernel) noexcept {
+        switch(kernel) {
+            #ifdef LAST_RESORT_X86_SIMD
+            case AdpcmKernel::ADPCM_KERNEL_SSE41:
+                return encode_lanes<8>(pcm, frame_count, available_frame_count, channel_count, big_endian, output, encode_block_lanes_sse41);
+            case AdpcmKernel::ADPCM_KERNEL_AVX2:
+                return encode_lanes<16>(pcm, frame_count, available_frame_count, channel_count, big_endian, output, encode_block_lanes_avx2);
+            #endif
+            default:
+                return encode_xbox_adpcm_scalar(pcm, frame_count, available_frame_count, channel_count, big_endian, output);
+        }
+    }
+
+    static AdpcmKernel best_kernel() noexcept {
+        static const AdpcmKernel kernel = adpcm_kernel_supported(AdpcmKernel::ADPCM_KERNEL_AVX2) ? AdpcmKernel::ADPCM_KERNEL_AVX2 : adpcm_kernel_supported(AdpcmKernel::ADPCM_KERNEL_SSE41) ? AdpcmKernel::ADPCM_KERNEL_SSE41 : AdpcmKernel::ADPCM_KERNEL_SCALAR;
+        return kernel;
+    }
+
+    void encode_xbox_adpcm_with_kernel(const std::byte *pcm, std::size_t frame_count, std::size_t channel_count, bool big_endian, std::byte *output, AdpcmKernel kernel) noexcept {
+        encode_blocks(pcm, frame_count, frame_count, channel_count, big_endian, output, kernel);
+    }
+
+    void encode_xbox_adpcm(const std::byte *pcm, std::size_t frame_count, std::size_t channel_count, bool big_endian, std::byte *output) noexcept {
+        encode_blocks(pcm, frame_count, frame_count, channel_count, big_endian, output, best_kernel());
+    }
+
+    // Append the blocks for some frames to the output, reading up to available_frame_count of them
+    static void append_blocks(const std::byte *pcm, std::size_t frame_count, std::size_t available_frame_count, std::size_t channel_count, bool big_endian, std::vector<std::byte> &output) {
+        std::size_t offset = output.size();
+        output.resize(offset + xbox_adpcm_size(frame_count, channel_count));
+        encode_blocks(pcm, frame_count, available_frame_count, channel_count, big_endian, output.data() + offset, best_kernel());
+    }
+
+    void XboxAdpcmStream::encode(const std::byte *pcm, std::size_t frame_count, std::vector<std::byte> &output) {
+        std::size_t frame_size = this->channel_count * sizeof(std::int16_t);
+
+        // Finish the block held back last time once we have the frame after it
+        if(!this->held_back.empty()) {
+            std::size_t held_back_frames = this->held_back.size() / frame_size;
+            std::size_t taken = std::min(frame_count, ENCODED_FRAMES - held_back_frames);
+            this->held_back.insert(this->held_back.end(), pcm, pcm + taken * frame_size);
+            if(this->held_back.size() < ENCODED_FRAMES * frame_size) {
+                return;
+            }
+            append_blocks(this->held_back.data(), XBOX_ADPCM_FRAMES_PER_BLOCK, ENCODED_FRAMES, this->channel_count, this->big_endian, output);
+            this->held_back.clear();
+
+            // The frame after that block starts the next one
+            std::size_t used = XBOX_ADPCM_FRAMES_PER_BLOCK - held_back_frames;
+            pcm += used * frame_size;
+            frame_count -= used;
+        }
+
+        // Encode every block we have the frame after, and hold back the rest
+        std::size_t block_frames = frame_count > 0 ? (frame_count - 1) / XBOX_ADPCM_FRAMES_PER_BLOCK * XBOX_ADPCM_FRAMES_PER_BLOCK : 0;
+        if(block_frames > 0) {
+            append_blocks(pcm, block_frames, block_frames + 1, this->channel_count, this->big_endian, output);
+        }
+        this->held_back.assign(pcm + block_frames * frame_size, pcm + frame_count * frame_size);
+    }
+
+    void XboxAdpcmStream::finish(std::vector<std::byte> &output) {
+        std::size_t held_back_frames = this->held_back.size() / (this->channel_count * sizeof(std::int16_t));
+        if(held_back_frames > 0) {
+            append_blocks(this->held_back.data(), held_back_frames, held_back_frames, this->channel_count, this->big_endian, output);
+        }
+        this->held_back.clear();
+    }
+
+    XboxAdpcmStream::XboxAdpcmStream(std::size_t channel_count, bool big_endian) : channel_count(channel_count), big_endian(big_endian) {
+        this->held_back.reserve(ENCODED_FRAMES * channel_count * sizeof(std::int16_t));
+    }
+}
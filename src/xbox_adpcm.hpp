@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAST_RESORT__XBOX_ADPCM_HPP
+#define LAST_RESORT__XBOX_ADPCM_HPP
+
+#include <cstddef>
+#include <vector>
+
+namespace LastResort {
+    /**
+     * Sample frames in each Xbox ADPCM block. The first one is stored in the header and the other 63 in the first 63 of
+     * its 64 nibbles. Invader's encoder and decoder both use 64 frames per block (tests/xbox_adpcm_test.cpp checks this),
+     * so the last nibble is never played; we encode the first frame of the next block into it anyway so a decoder that
+     * does play it hears the sample it was about to get rather than a jump.
+     */
+    static constexpr const std::size_t XBOX_ADPCM_FRAMES_PER_BLOCK = 64;
+
+    /** Bytes per channel in each Xbox ADPCM block */
+    static constexpr const std::size_t XBOX_ADPCM_BLOCK_SIZE = 36;
+
+    enum AdpcmKernel {
+        ADPCM_KERNEL_SCALAR,
+        ADPCM_KERNEL_SSE41,
+        ADPCM_KERNEL_AVX2,
+
+        ADPCM_KERNEL_COUNT
+    };
+
+    /**
+     * Get the size of the Xbox ADPCM data for some 16-bit PCM
+     * @param frame_count   number of sample frames
+     * @param channel_count number of channels
+     * @return              size in bytes
+     */
+    std::size_t xbox_adpcm_size(std::size_t frame_count, std::size_t channel_count) noexcept;
+
+    /**
+     * Get whether or not the CPU can run a kernel
+     * @param kernel kernel
+     * @return       true if supported
+     */
+    bool adpcm_kernel_supported(AdpcmKernel kernel) noexcept;
+
+    /**
+     * Get the name of a kernel
+     * @param kernel kernel
+     * @return       name
+     */
+    const char *adpcm_kernel_name(AdpcmKernel kernel) noexcept;
+
+    /**
+     * Encode 16-bit PCM to Xbox ADPCM, using SSE4.1 or AVX2 if the CPU supports it. This is our own encoder rather than a
+     * faster version of Invader's, so the output isn't the same as Invader's.
+     *
+     * Every block and channel is encoded on its own, so they can be done side by side in vector lanes: each block starts
+     * from the step index found by running the encoder over its first few samples rather than the one the previous
+     * block ended on. The last block is padded with silence. Every kernel gives exactly the same output as the scalar one,
+     * and tests/xbox_adpcm_test.cpp checks every nibble and decodes the output with Invader's decoder. To encode a sound
+     * a piece at a time, use XboxAdpcmStream, since the last nibble of each block depends on the frame after it.
+     *
+     * @param pcm           interleaved 16-bit PCM
+     * @param frame_count   number of sample frames
+     * @param channel_count number of channels
+     * @param big_endian    the PCM is big endian (as stored in tags) rather than little endian
+     * @param output        buffer of xbox_adpcm_size() bytes to write to
+     */
+    void encode_xbox_adpcm(const std::byte *pcm, std::size_t frame_count, std::size_t channel_count, bool big_endian, std::byte *output) noexcept;
+
+    /**
+     * Encode 16-bit PCM to Xbox ADPCM with a specific kernel (see encode_xbox_adpcm())
+     * @param pcm           interleaved 16-bit PCM
+     * @param frame_count   number of sample frames
+     * @param channel_count number of channels
+     * @param big_endian    the PCM is big endian (as stored in tags) rather than little endian
+     * @param output        buffer of xbox_adpcm_size() bytes to write to
+     * @param kernel        kernel to use; it must be supported
+     */
+    void encode_xbox_adpcm_with_kernel(const std::byte *pcm, std::size_t frame_count, std::size_t channel_count, bool big_endian, std::byte *output, AdpcmKernel kernel) noexcept;
+
+    /**
+     * Encodes a sound to Xbox ADPCM a chunk at a time, giving exactly the same output as encode_xbox_adpcm() would give
+     * for the whole sound however it's split into chunks. Up to a block's worth of each chunk is held back until the
+     * frame after it arrives.
+     */
+    class XboxAdpcmStream {
+    public:
+        /**
+         * Encode the next chunk of the sound, appending every block that can be finished to the output
+         * @param pcm         interleaved 16-bit PCM
+         * @param frame_count number of sample frames
+         * @param output      buffer to append to
+         */
+        void encode(const std::byte *pcm, std::size_t frame_count, std::vector<std::byte> &output);
+
+        /**
+         * Encode whatever was held back, padding the last block with silence
+         * @param output buffer to append to
+         */
+        void finish(std::vector<std::byte> &output);
+
+        /**
+         * Instantiate a stream
+         * @param channel_count number of channels
+         * @param big_endian    the PCM is big endian (as stored in tags) rather than little endian
+         */
+        XboxAdpcmStream(std::size_t channel_count, bool big_endian);
+
+    private:
+        std::size_t channel_count;
+        bool big_endian;
+        std::vector<std::byte> held_back;
+    };
+}
+
+#endif
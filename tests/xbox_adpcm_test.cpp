@@ -0,0 +1,311 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <invader/printf.hpp>
+#include <invader/sound/sound_encoder.hpp>
+#include <invader/sound/sound_reader.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../src/sound_stream.hpp"
+#include "../src/xbox_adpcm.hpp"
+
+// Checks Last Resort's Xbox ADPCM encoder (--fast-adpcm). It isn't a copy of Invader's encoder and doesn't give the same
+// bytes, so it's held to the format instead: the output has to be the same size as Invader's, every nibble has to be the
+// one IMA ADPCM quantization picks for its sample, and Invader's decoder has to read back exactly the samples the
+// nibbles describe
+
+static constexpr const std::size_t SAMPLE_RATE = 44100;
+
+// Deterministic noise so every run tests the same samples
+struct Noise {
+    std::uint32_t state;
+
+    double next() noexcept {
+        this->state = this->state * 1664525 + 1013904223;
+        return static_cast<double>(this->state >> 8) / static_cast<double>(1 << 24) * 2.0 - 1.0;
+    }
+};
+
+enum Signal {
+    SIGNAL_SILENCE,
+    SIGNAL_TONES,
+    SIGNAL_SWEEP,
+    SIGNAL_NOISE,
+    SIGNAL_SQUARE,
+
+    SIGNAL_COUNT
+};
+
+static const char *signal_name(Signal signal) noexcept {
+    switch(signal) {
+        case Signal::SIGNAL_SILENCE:
+            return "silence";
+        case Signal::SIGNAL_TONES:
+            return "tones";
+        case Signal::SIGNAL_SWEEP:
+            return "sweep";
+        case Signal::SIGNAL_NOISE:
+            return "noise";
+        case Signal::SIGNAL_SQUARE:
+            return "square";
+        default:
+            return "unknown";
+    }
+}
+
+// Generate interleaved 16-bit little endian PCM
+static std::vector<std::byte> generate_pcm(Signal signal, std::size_t frame_count, std::size_t channel_count) {
+    std::vector<std::byte> pcm(frame_count * channel_count * sizeof(std::int16_t));
+    Noise noise = { 0x4C617374 };
+    double filtered[2] = {};
+    for(std::size_t f = 0; f < frame_count; f++) {
+        double t = static_cast<double>(f) / SAMPLE_RATE;
+        for(std::size_t c = 0; c < channel_count; c++) {
+            double value = 0.0;
+            switch(signal) {
+                case Signal::SIGNAL_TONES:
+                    value = 9000.0 * std::sin(2.0 * M_PI * (220.0 + 110.0 * c) * t) + 4000.0 * std::sin(2.0 * M_PI * 1375.0 * t) + 1500.0 * std::sin(2.0 * M_PI * 6100.0 * t);
+                    break;
+                case Signal::SIGNAL_SWEEP:
+                    value = 20000.0 * std::sin(2.0 * M_PI * (50.0 * t + 1000.0 * t * t));
+                    break;
+                case Signal::SIGNAL_NOISE:
+                    filtered[c] = filtered[c] * 0.7 + noise.next() * 9000.0;
+                    value = filtered[c];
+                    break;
+                case Signal::SIGNAL_SQUARE:
+                    value = (f / (50 + c * 13)) % 2 ? 32767.0 : -32768.0;
+                    break;
+                default:
+                    break;
+            }
+            auto sample = static_cast<std::uint16_t>(static_cast<std::int16_t>(std::clamp(std::lround(value), -32768L, 32767L)));
+            auto *bytes = pcm.data() + (f * channel_count + c) * sizeof(std::int16_t);
+            bytes[0] = static_cast<std::byte>(sample);
+            bytes[1] = static_cast<std::byte>(sample >> 8);
+        }
+    }
+    return pcm;
+}
+
+static std::int32_t sample_at(const std::vector<std::byte> &pcm, std::size_t index) noexcept {
+    auto low = static_cast<std::uint16_t>(pcm[index * 2]);
+    auto high = static_cast<std::uint16_t>(pcm[index * 2 + 1]);
+    return static_cast<std::int16_t>(static_cast<std::uint16_t>(high << 8 | low));
+}
+
+// IMA ADPCM as the format defines it, written out separately from the encoder
+static constexpr const std::int32_t IMA_STEP_TABLE[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107,
+    118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894,
+    6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767
+};
+static constexpr const std::int32_t IMA_INDEX_TABLE[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+struct ImaState {
+    std::int32_t predictor;
+    std::int32_t step_index;
+
+    // The nibble that gets closest to a sample without overshooting each bit, as the IMA quantizer picks it
+    std::int32_t quantize(std::int32_t sample) const noexcept {
+        std::int32_t difference = sample - this->predictor;
+        std::int32_t nibble = difference < 0 ? 8 : 0;
+        std::int32_t magnitude = std::abs(difference);
+        std::int32_t step = IMA_STEP_TABLE[this->step_index];
+        for(std::int32_t bit = 4; bit > 0; bit >>= 1, step >>= 1) {
+            if(magnitude >= step) {
+                nibble |= bit;
+                magnitude -= step;
+            }
+        }
+        return nibble;
+    }
+
+    void decode(std::int32_t nibble) noexcept {
+        std::int32_t step = IMA_STEP_TABLE[this->step_index];
+        std::int32_t difference = step >> 3;
+        if(nibble & 4) {
+            difference += step;
+        }
+        if(nibble & 2) {
+            difference += step >> 1;
+        }
+        if(nibble & 1) {
+            difference += step >> 2;
+        }
+        this->predictor = std::clamp(nibble & 8 ? this->predictor - difference : this->predictor + difference, -32768, 32767);
+        this->step_index = std::clamp(this->step_index + IMA_INDEX_TABLE[nibble & 7], 0, 88);
+    }
+};
+
+// Check every block of our output against the input, returning a description of the first problem found (if any) and
+// filling reconstructed with the samples the nibbles describe
+static std::string check_blocks(const std::vector<std::byte> &pcm, std::size_t frame_count, std::size_t channel_count, const std::vector<std::byte> &adpcm, std::vector<std::int32_t> &reconstructed) {
+    auto input_sample = [&](std::size_t frame, std::size_t channel) {
+        return frame < frame_count ? sample_at(pcm, frame * channel_count + channel) : 0;
+    };
+    auto *bytes = reinterpret_cast<const std::uint8_t *>(adpcm.data());
+    std::size_t block_size = LastResort::XBOX_ADPCM_BLOCK_SIZE * channel_count;
+    std::size_t block_count = adpcm.size() / block_size;
+    reconstructed.assign(block_count * LastResort::XBOX_ADPCM_FRAMES_PER_BLOCK * channel_count, 0);
+
+    for(std::size_t block = 0; block < block_count; block++) {
+        std::size_t first_frame = block * LastResort::XBOX_ADPCM_FRAMES_PER_BLOCK;
+        for(std::size_t channel = 0; channel < channel_count; channel++) {
+            auto where = " (block " + std::to_string(block) + ", channel " + std::to_string(channel);
+            auto *header = bytes + block * block_size + channel * 4;
+            ImaState state = { static_cast<std::int16_t>(static_cast<std::uint16_t>(header[1] << 8 | header[0])), header[2] };
+            if(state.step_index > 88 || header[3] != 0) {
+                return "bad header" + where + ")";
+            }
+            if(state.predictor != input_sample(first_frame, channel)) {
+                return "header sample isn't the first sample" + where + ")";
+            }
+            reconstructed[first_frame * channel_count + channel] = state.predictor;
+
+            // Nibbles come 8 to a group of 4 bytes, with the groups of each channel interleaved; the last nibble is
+            // for the first frame of the next block
+            for(std::size_t n = 0; n < LastResort::XBOX_ADPCM_FRAMES_PER_BLOCK; n++) {
+                auto byte = bytes[block * block_size + channel_count * 4 + ((n / 8) * channel_count + channel) * 4 + (n % 8) / 2];
+                std::int32_t nibble = n % 2 ? byte >> 4 : byte & 0xF;
+                std::size_t frame = first_frame + n + 1;
+                if(nibble != state.quantize(input_sample(frame, channel))) {
+                    return "nibble " + std::to_string(n) + " isn't the one its sample quantizes to" + where + ")";
+                }
+                state.decode(nibble);
+                if(n + 1 < LastResort::XBOX_ADPCM_FRAMES_PER_BLOCK) {
+                    reconstructed[frame * channel_count + channel] = state.predictor;
+                }
+            }
+        }
+    }
+    return {};
+}
+
+static std::size_t failures = 0;
+
+static void check(const std::string &name, bool passed, const char *detail = "") {
+    if(passed) {
+        std::printf("ok    %s%s\n", name.c_str(), detail);
+    }
+    else {
+        eprintf_error("FAIL  %s%s", name.c_str(), detail);
+        failures++;
+    }
+}
+
+static void test_case(Signal signal, std::size_t frame_count, std::size_t channel_count) {
+    auto name = std::string(signal_name(signal)) + (channel_count == 1 ? "-mono-" : "-stereo-") + std::to_string(frame_count);
+    auto pcm = generate_pcm(signal, frame_count, channel_count);
+
+    // Both encoders have to agree on how many blocks the samples take
+    auto invader = Invader::SoundEncoder::encode_to_xbox_adpcm(pcm, 16, channel_count);
+    std::vector<std::byte> ours(LastResort::xbox_adpcm_size(frame_count, channel_count));
+    check(name + " size", invader.size() == ours.size());
+    if(invader.size() != ours.size()) {
+        return;
+    }
+
+    // Every kernel has to give the same bytes, with the little and big endian input alike
+    LastResort::encode_xbox_adpcm_with_kernel(pcm.data(), frame_count, channel_count, false, ours.data(), LastResort::AdpcmKernel::ADPCM_KERNEL_SCALAR);
+    auto big_endian = pcm;
+    for(std::size_t b = 0; b < big_endian.size(); b += 2) {
+        std::swap(big_endian[b], big_endian[b + 1]);
+    }
+    for(std::size_t k = 0; k < LastResort::AdpcmKernel::ADPCM_KERNEL_COUNT; k++) {
+        auto kernel = static_cast<LastResort::AdpcmKernel>(k);
+        if(!LastResort::adpcm_kernel_supported(kernel)) {
+            continue;
+        }
+        std::vector<std::byte> kernel_output(ours.size());
+        LastResort::encode_xbox_adpcm_with_kernel(pcm.data(), frame_count, channel_count, false, kernel_output.data(), kernel);
+        bool same = kernel_output == ours;
+        LastResort::encode_xbox_adpcm_with_kernel(big_endian.data(), frame_count, channel_count, true, kernel_output.data(), kernel);
+        check(name + " " + LastResort::adpcm_kernel_name(kernel), same && kernel_output == ours);
+    }
+
+    // Every nibble has to be the right one for its sample
+    std::vector<std::int32_t> reconstructed;
+    auto problem = check_blocks(pcm, frame_count, channel_count, ours, reconstructed);
+    check(name + " nibbles", problem.empty(), problem.empty() ? "" : (": " + problem).c_str());
+
+    // Invader's decoder has to read back as many frames from ours as from its own, and exactly the samples the nibbles
+    // describe; a block laid out differently from how Invader reads it can't pass this
+    auto invader_decoded = Invader::SoundReader::sound_from_xbox_adpcm(invader.data(), invader.size(), channel_count, SAMPLE_RATE);
+    auto ours_decoded = Invader::SoundReader::sound_from_xbox_adpcm(ours.data(), ours.size(), channel_count, SAMPLE_RATE);
+    bool decoded = invader_decoded.bits_per_sample == 16 && ours_decoded.bits_per_sample == 16 && ours_decoded.channel_count == channel_count;
+    check(name + " decode", decoded);
+    if(!decoded) {
+        return;
+    }
+    check(name + " frames", ours_decoded.pcm.size() == invader_decoded.pcm.size() && ours_decoded.pcm.size() == reconstructed.size() * sizeof(std::int16_t));
+    if(ours_decoded.pcm.size() != reconstructed.size() * sizeof(std::int16_t)) {
+        return;
+    }
+    std::size_t mismatched = 0;
+    for(std::size_t s = 0; s < reconstructed.size(); s++) {
+        mismatched += sample_at(ours_decoded.pcm, s) != reconstructed[s];
+    }
+    char detail[64];
+    std::snprintf(detail, sizeof(detail), mismatched == 0 ? "" : " (%zu samples differ)", mismatched);
+    check(name + " decoded samples", mismatched == 0, detail);
+}
+
+// Encoding a sound a chunk at a time, as sound_to_xbox_adpcm does, has to give the same bytes as encoding it whole
+static void test_chunks(Signal signal, std::size_t frame_count, std::size_t channel_count, std::size_t chunk_frames, bool big_endian) {
+    auto name = std::string(signal_name(signal)) + (channel_count == 1 ? "-mono-" : "-stereo-") + std::to_string(frame_count) + " chunks of " + std::to_string(chunk_frames) + (big_endian ? " big endian" : "");
+    auto pcm = generate_pcm(signal, frame_count, channel_count);
+    if(big_endian) {
+        for(std::size_t b = 0; b < pcm.size(); b += 2) {
+            std::swap(pcm[b], pcm[b + 1]);
+        }
+    }
+
+    std::vector<std::byte> whole(LastResort::xbox_adpcm_size(frame_count, channel_count));
+    LastResort::encode_xbox_adpcm(pcm.data(), frame_count, channel_count, big_endian, whole.data());
+
+    std::vector<std::byte> chunked;
+    LastResort::XboxAdpcmStream stream(channel_count, big_endian);
+    std::size_t frame_size = channel_count * sizeof(std::int16_t);
+    for(std::size_t f = 0; f < frame_count; f += chunk_frames) {
+        stream.encode(pcm.data() + f * frame_size, std::min(chunk_frames, frame_count - f), chunked);
+    }
+    stream.finish(chunked);
+    check(name, chunked == whole);
+}
+
+int main() {
+    // Lengths around block boundaries (4160 frames is 65 blocks of 64 but 64 of 65), and a long sound
+    static constexpr const std::size_t frame_counts[] = { 1, 2, 63, 64, 65, 127, 128, 129, 4159, 4160, 4161, SAMPLE_RATE * 10 };
+    for(std::size_t channel_count = 1; channel_count <= 2; channel_count++) {
+        for(std::size_t s = 0; s < Signal::SIGNAL_COUNT; s++) {
+            for(auto frame_count : frame_counts) {
+                test_case(static_cast<Signal>(s), frame_count, channel_count);
+            }
+        }
+    }
+
+    // Chunks as big as sound_to_xbox_adpcm uses over a sound more than two chunks long, then chunk sizes that end mid-block
+    for(std::size_t channel_count = 1; channel_count <= 2; channel_count++) {
+        for(bool big_endian : { false, true }) {
+            test_chunks(Signal::SIGNAL_TONES, LastResort::PCM_FRAMES_PER_CHUNK * 2 + 1000, channel_count, LastResort::PCM_FRAMES_PER_CHUNK, big_endian);
+            for(std::size_t chunk_frames : { 1, 63, 64, 65, 100, 4097 }) {
+                test_chunks(Signal::SIGNAL_NOISE, 20000, channel_count, chunk_frames, big_endian);
+            }
+        }
+    }
+
+    if(failures > 0) {
+        eprintf_error("%zu check%s failed", failures, failures == 1 ? "" : "s");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}